@@ -0,0 +1,327 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "AOT.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define CPU_OPCODE_NAME(name) #name,
+static char const* const opNames[] = { CPU_OPCODES(CPU_OPCODE_NAME, CPU_OPCODE_NAME) };
+#undef CPU_OPCODE_NAME
+
+// Handlers that take the quirk policy as template argument
+#define CPU_OPCODE_PLAIN(name) false,
+#define CPU_OPCODE_QUIRK(name) true,
+static bool const quirkOps[] = { CPU_OPCODES(CPU_OPCODE_PLAIN, CPU_OPCODE_QUIRK) };
+#undef CPU_OPCODE_QUIRK
+#undef CPU_OPCODE_PLAIN
+
+AOT::~AOT() {
+	if (!module)
+		return;
+#if defined(_WIN32)
+	FreeLibrary((HMODULE)module);
+#else
+	dlclose(module);
+#endif
+}
+
+// Translate: Discover the basic blocks reachable from the start address and write them out as C++.
+// Every instruction calls its OP_* handler from CPU.cpp, which the module includes so they inline.
+int AOT::Translate(char const* romFileName, char const* outFileName, char const* variantName) {
+	std::ifstream file(romFileName, std::ios::binary);
+	std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// Quirk policy type the handlers are instantiated with
+	std::string const variant = variantName;
+	char const* policy = nullptr;
+#define AOT_POLICY_TYPE(type) \
+	if (variant == type::name) \
+		policy = #type;
+	CPU_QUIRK_POLICIES(AOT_POLICY_TYPE)
+#undef AOT_POLICY_TYPE
+	if (!policy) {
+		std::cout << "Unknown variant: " << variantName << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::unique_ptr<CPU> cpu = CPU::Create(variant);
+	cpu->LoadROM(romFileName);
+	if (!cpu->isRomLoaded())
+		return EXIT_FAILURE;
+
+	std::ofstream out(outFileName);
+	if (!out.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	out << "// Recompiled from " << romFileName << " for the " << variantName << " variant by ChipEi --translate.\n";
+	out << "// Build as a shared object next to the ChipEi sources, e.g.\n";
+	out << "//   g++ -O2 -shared -fPIC " << CHIPEI_AOT_BUILD_DEFINES << "-I<ChipEi> " << outFileName << " -o <Module>.so\n";
+	out << "// with the defines of the ChipEi build that loads it.\n";
+	out << "#include \"CPU.cpp\"\n";
+	out << "#if defined(CHIPEI_TRACE)\n#include \"Trace.cpp\"\n#endif\n";
+	out << "#include \"AOT.h\"\n\n";
+	out << "struct Recompiled {\n";
+	out << "\tstatic void Tick(CPU& cpu, uint32_t ticks) {\n";
+	out << "\t\tif (!cpu.tickTimersPerCycle) return;\n";
+	out << "\t\tcpu.delayTimer = cpu.delayTimer > ticks ? cpu.delayTimer - ticks : 0;\n";
+	out << "\t\tcpu.soundTimer = cpu.soundTimer > ticks ? cpu.soundTimer - ticks : 0;\n";
+	out << "\t}\n\n";
+	out << std::hex << std::uppercase << std::setfill('0');
+
+	// Walk the control flow from the start address
+	std::set<uint16_t> pending{ (uint16_t)cst::START_ADDRESS };
+	std::set<uint16_t> done;
+	std::vector<std::pair<uint16_t, uint16_t>> translated;
+
+	while (!pending.empty()) {
+		uint16_t start = *pending.begin();
+		pending.erase(pending.begin());
+		if (!done.insert(start).second || (start & 1u) || start > cst::MEMORY_SIZE - 2)
+			continue;
+
+		std::vector<CPU::Instruction> instructions;
+		uint16_t address = start;
+		bool terminated = false;
+		while (!terminated && address <= cst::MEMORY_SIZE - 2) {
+			CPU::Instruction instruction = cpu->Fetch(address);
+			instructions.push_back(instruction);
+			address += 2;
+
+			switch (instruction.op) {
+				case CPU::ID_1nnn:
+					pending.insert(instruction.nnn);
+					terminated = true;
+					break;
+				case CPU::ID_2nnn:
+					pending.insert(instruction.nnn);
+					pending.insert(address);
+					terminated = true;
+					break;
+				case CPU::ID_3xkk: case CPU::ID_4xkk: case CPU::ID_5xy0: case CPU::ID_9xy0:
+				case CPU::ID_Ex9E: case CPU::ID_ExA1: case CPU::ID_ExF2: case CPU::ID_ExF5:
+				case CPU::ID_5xy1_E: case CPU::ID_5xy2: case CPU::ID_5xy3:
+					pending.insert(address);
+					pending.insert(address + 2);
+					terminated = true;
+					break;
+				case CPU::ID_Fx0A:
+					pending.insert(address);
+					terminated = true;
+					break;
+				case CPU::ID_00EE: case CPU::ID_Bnnn: case CPU::ID_00FD:
+					// Returns and computed jumps continue wherever the interpreter lands
+					terminated = true;
+					break;
+			}
+		}
+		if (!terminated && address <= cst::MEMORY_SIZE - 2)
+			pending.insert(address);
+
+		out << "\tstatic uint32_t Block_" << std::setw(4) << start << "(CPU& cpu) {\n";
+		out << "\t\tstatic CPU::Instruction const i[] = {\n";
+		for (CPU::Instruction const& instruction : instructions) {
+			out << "\t\t\t{ 0x" << std::setw(4) << instruction.opcode << ", 0x" << std::setw(3) << instruction.nnn
+				<< ", 0x" << (int)instruction.x << ", 0x" << (int)instruction.y << ", 0x" << (int)instruction.n
+				<< ", 0x" << std::setw(2) << (int)instruction.kk << ", CPU::ID_" << opNames[instruction.op] << ", true, false },\n";
+		}
+		out << "\t\t};\n";
+
+		// PC is only stored where a handler reads it and at the exits, timer ticks are batched
+		// up to the next handler that touches the timers
+		uint32_t pendingTicks = 0;
+		auto tick = [&]() {
+			if (pendingTicks)
+				out << "\t\tTick(cpu, " << std::dec << pendingTicks << std::hex << ");\n";
+			pendingTicks = 0;
+		};
+		for (size_t k = 0; k < instructions.size(); ++k) {
+			CPU::Instruction const& instruction = instructions[k];
+			bool last = k + 1 == instructions.size();
+			bool store = instruction.op == CPU::ID_Fx33 || instruction.op == CPU::ID_Fx55 || instruction.op == CPU::ID_9xy3;
+
+			if (instruction.op == CPU::ID_Fx07 || instruction.op == CPU::ID_Fx15 || instruction.op == CPU::ID_Fx18)
+				tick();
+			if (last || store)
+				out << "\t\tcpu.pc = 0x" << std::setw(4) << (start + 2 * (k + 1)) << ";\n";
+			if (instruction.op == CPU::ID_NULL)
+				out << "\t\tcpu.opcode = 0x" << std::setw(4) << instruction.opcode << ";\n";
+			out << "\t\tcpu.inst = &i[" << std::dec << k << std::hex << "]; cpu.OP_" << opNames[instruction.op];
+			if (quirkOps[instruction.op])
+				out << "<" << policy << ">";
+			out << "();\n";
+			++pendingTicks;
+
+			// Stop right after a store into code so the host can drop stale blocks
+			if (store) {
+				tick();
+				out << "\t\tif (cpu.codeModified) return " << std::dec << (k + 1) << std::hex << ";\n";
+			}
+		}
+		tick();
+		out << "\t\treturn " << std::dec << instructions.size() << std::hex << ";\n";
+		out << "\t}\n";
+
+		translated.push_back({ start, address });
+	}
+	out << "};\n\n";
+
+	// Exported tables
+	out << "extern \"C\" CHIPEI_AOT_EXPORT AotBlock const chipei_aot_blocks[] = {\n";
+	for (auto const& block : translated) {
+		out << "\t{ 0x" << std::setw(4) << block.first << ", 0x" << std::setw(4) << block.second
+			<< ", &Recompiled::Block_" << std::setw(4) << block.first << " },\n";
+	}
+	out << "};\n";
+	out << "extern \"C\" CHIPEI_AOT_EXPORT uint32_t const chipei_aot_block_count = " << std::dec << translated.size() << ";\n\n";
+
+	out << "extern \"C\" CHIPEI_AOT_EXPORT uint8_t const chipei_aot_rom[] = {";
+	out << std::hex;
+	for (size_t i = 0; i < image.size(); ++i) {
+		out << (i % 16 ? " " : "\n\t") << "0x" << std::setw(2) << (int)image[i] << ",";
+	}
+	out << "\n};\n";
+	out << "extern \"C\" CHIPEI_AOT_EXPORT uint32_t const chipei_aot_rom_size = " << std::dec << image.size() << ";\n";
+	out << "extern \"C\" CHIPEI_AOT_EXPORT char const chipei_aot_variant[] = \"" << variantName << "\";\n";
+	out << "extern \"C\" CHIPEI_AOT_EXPORT uint32_t const chipei_aot_cpu_size = sizeof(CPU);\n";
+	out << "extern \"C\" CHIPEI_AOT_EXPORT char const chipei_aot_build[] = CHIPEI_AOT_BUILD_DEFINES;\n";
+
+	std::cout << std::dec << "Translated " << translated.size() << " blocks into " << outFileName << std::endl;
+	return EXIT_SUCCESS;
+}
+
+// Load a compiled module for the ROM loaded into cpu. A name without a directory is a file in the
+// working directory, not one searched for in the library paths.
+bool AOT::Load(char const* moduleFileName, CPU& cpu) {
+#if defined(_WIN32)
+	module = LoadLibraryA(moduleFileName);
+	auto symbol = [&](char const* name) { return (void*)GetProcAddress((HMODULE)module, name); };
+	if (!module) {
+		std::cout << "Module failed to load: " << moduleFileName << " (error " << GetLastError() << ")" << std::endl;
+		return false;
+	}
+#else
+	std::string path = moduleFileName;
+	if (path.find('/') == std::string::npos)
+		path = "./" + path;
+	module = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	auto symbol = [&](char const* name) { return dlsym(module, name); };
+	if (!module) {
+		char const* error = dlerror();
+		std::cout << "Module failed to load: " << (error ? error : moduleFileName) << std::endl;
+		return false;
+	}
+#endif
+
+	moduleBlocks = (AotBlock const*)symbol("chipei_aot_blocks");
+	uint32_t const* blockCount = (uint32_t const*)symbol("chipei_aot_block_count");
+	rom = (uint8_t const*)symbol("chipei_aot_rom");
+	uint32_t const* size = (uint32_t const*)symbol("chipei_aot_rom_size");
+	char const* variant = (char const*)symbol("chipei_aot_variant");
+	if (!moduleBlocks || !blockCount || !rom || !size || !variant) {
+		std::cout << "Module is not a recompiled ROM: " << moduleFileName << std::endl;
+		return false;
+	}
+	moduleBlockCount = *blockCount;
+	romSize = *size;
+
+	// The blocks access CPU members at the offsets of the module's own build
+	uint32_t const* cpuSize = (uint32_t const*)symbol("chipei_aot_cpu_size");
+	char const* build = (char const*)symbol("chipei_aot_build");
+	if (!cpuSize || !build || *cpuSize != sizeof(CPU) || std::string(build) != CHIPEI_AOT_BUILD_DEFINES) {
+		std::cout << "Module was built with other options than this ChipEi (\"" << (build ? build : "") << "\" instead of \""
+			<< CHIPEI_AOT_BUILD_DEFINES << "\"), build it again: " << moduleFileName << std::endl;
+		return false;
+	}
+
+	// Handlers were instantiated for one variant's quirks
+	if (std::string(variant) != cpu.variantName()) {
+		std::cout << "Module was translated for the " << variant << " variant: " << moduleFileName << std::endl;
+		return false;
+	}
+
+	// The module must have been translated from the ROM that is loaded
+	if (romSize > cst::MEMORY_SIZE - cst::START_ADDRESS
+		|| std::memcmp(rom, cpu.memory + cst::START_ADDRESS, romSize) != 0) {
+		std::cout << "Module was translated from a different ROM: " << moduleFileName << std::endl;
+		return false;
+	}
+
+	// Enable every block and watch its code
+	for (uint32_t i = 0; i < moduleBlockCount; ++i) {
+		AotBlock const& block = moduleBlocks[i];
+		blocks[block.start >> 1] = &block;
+		for (uint16_t address = block.start; address < block.end; address += 2) {
+			cpu.Fetch(address);
+			cpu.decodeCache[address >> 1].watched = true;
+		}
+	}
+	return true;
+}
+
+// Step: Run the block at PC, or interpret a single instruction if there is none or it is longer than limit
+uint32_t AOT::Step(CPU& cpu, uint32_t limit) {
+	if (cpu.codeModified)
+		Invalidate(cpu);
+
+	uint16_t pc = cpu.pc;
+	AotBlock const* block = (pc & 1u) || pc > cst::MEMORY_SIZE - 2 ? nullptr : blocks[pc >> 1];
+	if (block && (uint32_t)(block->end - block->start) / 2 > limit)
+		block = nullptr;
+
+	uint32_t executed = 1;
+	if (block) {
+		executed = block->run(cpu);
+	} else {
+		cpu.Cycle();
+	}
+
+	if (cpu.codeModified)
+		Invalidate(cpu);
+	return executed;
+}
+
+// Run exactly a frame of instructions like CPU::RunFrame, a block that would cross the end of the frame is
+// interpreted instead, then tick the timers once. Returns instructions executed.
+uint32_t AOT::RunFrame(CPU& cpu, uint32_t instructionsPerFrame) {
+	uint32_t executed = 0;
+	while (executed < instructionsPerFrame)
+		executed += Step(cpu, instructionsPerFrame - executed);
+	cpu.TickTimers();
+	return executed;
+}
+
+// Disable blocks whose code no longer matches the ROM they were translated from
+void AOT::Invalidate(CPU& cpu) {
+	for (uint32_t i = 0; i < moduleBlockCount; ++i) {
+		AotBlock const& block = moduleBlocks[i];
+		if (blocks[block.start >> 1] != &block)
+			continue;
+
+		for (uint16_t address = block.start; address < block.end; address += 2) {
+			if (cpu.decodeCache[address >> 1].valid)
+				continue;
+
+			// Rewriting the same bytes keeps the block
+			uint32_t offset = address - cst::START_ADDRESS;
+			bool same = address >= cst::START_ADDRESS && offset + 2 <= romSize
+				&& cpu.memory[address] == rom[offset] && cpu.memory[address + 1] == rom[offset + 1];
+			if (!same) {
+				blocks[block.start >> 1] = nullptr;
+				break;
+			}
+			cpu.Fetch(address);
+		}
+	}
+	cpu.codeModified = false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include "CPU.h"
+
+#if defined(_WIN32)
+#define CHIPEI_AOT_EXPORT __declspec(dllexport)
+#else
+#define CHIPEI_AOT_EXPORT __attribute__((visibility("default")))
+#endif
+
+// Build options that change the layout of CPU. A module compiles its own copy of CPU.cpp, so it only loads
+// into a host built with the same ones (and the same sizeof(CPU)).
+#if defined(CHIPEI_TRACE)
+#define CHIPEI_AOT_TRACE_DEFINE "-DCHIPEI_TRACE "
+#else
+#define CHIPEI_AOT_TRACE_DEFINE ""
+#endif
+#if defined(CHIPEI_PROFILE)
+#define CHIPEI_AOT_PROFILE_DEFINE "-DCHIPEI_PROFILE "
+#else
+#define CHIPEI_AOT_PROFILE_DEFINE ""
+#endif
+#define CHIPEI_AOT_BUILD_DEFINES CHIPEI_AOT_TRACE_DEFINE CHIPEI_AOT_PROFILE_DEFINE
+
+// Recompiled basic block exported by a module: runs [start, end) and returns the instructions executed
+struct AotBlock {
+	uint16_t start;
+	uint16_t end;
+	uint32_t (*run)(CPU& cpu);
+};
+
+// Ahead-of-time recompiler: translates a ROM into a C++ module with one function per basic block,
+// and runs a compiled module in place of the interpreter. Computed jumps (Bnnn) and code changed
+// by stores fall back to CPU::Cycle.
+class AOT {
+public:
+	~AOT();
+	static int Translate(char const* romFileName, char const* outFileName, char const* variantName);
+
+	bool Load(char const* moduleFileName, CPU& cpu);
+	uint32_t Step(CPU& cpu, uint32_t limit = UINT32_MAX); // Run one block of at most limit instructions or one interpreted instruction, returns instructions executed
+	uint32_t RunFrame(CPU& cpu, uint32_t instructionsPerFrame); // Exactly a frame of instructions, then the timers (clear tickTimersPerCycle)
+private:
+	void Invalidate(CPU& cpu);
+
+	void* module{};
+	AotBlock const* blocks[cst::MEMORY_SIZE / 2]{}; // Enabled blocks by (even) start address
+	AotBlock const* moduleBlocks{};
+	uint32_t moduleBlockCount{};
+	uint8_t const* rom{}; // ROM image the module was translated from
+	uint32_t romSize{};
+};
\ No newline at end of file
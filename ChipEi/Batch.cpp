@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "Batch.h"
+#include "HeadlessPlatform.h"
+#include "JIT.h"
+#include "WorkStealingPool.h"
+
+// Read the job file, then every ROM and input script it names
+bool Batch::Load(char const* jobFileName) {
+	std::ifstream file(jobFileName);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open job file " << jobFileName << "\n";
+		return false;
+	}
+
+	std::string line;
+	for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream fields(line);
+		BatchJob job;
+		if (!(fields >> job.rom))
+			continue;
+
+		bool valid = true;
+		std::string field;
+		while (valid && fields >> field) {
+			size_t separator = field.find('=');
+			std::string key = field.substr(0, separator);
+			std::string value = separator == std::string::npos ? "" : field.substr(separator + 1);
+			try {
+				if (key == "variant")
+					job.variant = value;
+				else if (key == "keys")
+					job.keys = value;
+				else if (key == "frames")
+					job.frames = std::stoul(value);
+				else if (key == "cycles")
+					job.cycles = std::stoull(value);
+				else if (key == "ipf")
+					job.instructionsPerFrame = std::stoul(value);
+				else if (key == "seed")
+					job.seed = std::stoul(value);
+				else if (key == "jit")
+					job.jit = std::stoul(value) != 0;
+				else
+					valid = false;
+			} catch (std::exception const&) {
+				valid = false;
+			}
+		}
+		if (!valid || job.instructionsPerFrame == 0) {
+			std::cerr << jobFileName << ":" << lineNumber << ": invalid job: " << line << "\n";
+			return false;
+		}
+		if (!CPU::Create(job.variant)) {
+			std::cerr << jobFileName << ":" << lineNumber << ": unknown variant " << job.variant << "\n";
+			return false;
+		}
+
+		if (roms.find(job.rom) == roms.end()) {
+			std::ifstream rom(job.rom, std::ios::binary);
+			if (!rom.is_open()) {
+				std::cerr << "Failed to open ROM " << job.rom << "\n";
+				return false;
+			}
+			roms[job.rom].assign(std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>());
+		}
+		if (!job.keys.empty() && scripts.find(job.keys) == scripts.end()) {
+			if (!scripts[job.keys].Load(job.keys.c_str()))
+				return false;
+		}
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+// Run every job, results are kept in job order
+void Batch::Run(unsigned int threadCount) {
+	results.assign(jobs.size(), BatchResult());
+
+	WorkStealingPool pool(threadCount);
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		pool.Submit([this, i] { results[i] = RunJob(jobs[i]); });
+	}
+	pool.Wait();
+
+	threads = pool.threadCount();
+	steals = pool.stealCount();
+}
+
+// Run one instance until its frame or cycle budget runs out, the script quits or the ROM exits
+BatchResult Batch::RunJob(BatchJob const& job) const {
+	BatchResult result;
+	auto start = std::chrono::steady_clock::now();
+
+	std::unique_ptr<CPU> cpu = CPU::Create(job.variant);
+	std::vector<uint8_t> const& rom = roms.at(job.rom);
+	cpu->reportUnknownOpcodes = false;
+	cpu->Seed(job.seed);
+	cpu->LoadROM(rom.data(), rom.size());
+	if (!cpu->isRomLoaded()) {
+		result.error = "ROM too large";
+		return result;
+	}
+
+	// The JIT ticks the timers per frame like RunFrame
+	std::unique_ptr<JIT> jit;
+	if (job.jit) {
+		jit.reset(new JIT());
+		cpu->tickTimersPerCycle = false;
+	}
+
+	InputScript const* script = job.keys.empty() ? nullptr : &scripts.at(job.keys);
+	size_t nextInput = 0;
+	while (result.frames < job.frames) {
+		if (script && script->Apply(result.frames, cpu->keypad, nextInput))
+			break;
+
+		if (job.cycles) {
+			if (result.instructions >= job.cycles)
+				break;
+			uint64_t left = job.cycles - result.instructions;
+			if (left < job.instructionsPerFrame) { // Partial last frame, timers don't tick
+				if (!jit) {
+					result.instructions += cpu->RunCycles((uint32_t)left);
+					break;
+				}
+				while (result.instructions < job.cycles)
+					result.instructions += jit->Step(*cpu, (uint32_t)(job.cycles - result.instructions));
+				break;
+			}
+		}
+
+		result.instructions += jit ? jit->RunFrame(*cpu, job.instructionsPerFrame) : cpu->RunFrame(job.instructionsPerFrame);
+		++result.frames;
+		if (cpu->shouldClose()) {
+			result.exited = true;
+			break;
+		}
+	}
+
+	result.skipped = cpu->skippedInstructions();
+	result.unknownOpcodes = cpu->unknownOpcodeCount();
+	result.hash = HeadlessPlatform::Hash(cpu->display(), cst::VIDEO_WIDTH, cst::VIDEO_HEIGHT);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// Escape a string for a CSV field
+static std::string CsvField(std::string const& text) {
+	if (text.find_first_of(",\"\n") == std::string::npos)
+		return text;
+
+	std::string field = "\"";
+	for (char c : text) {
+		if (c == '"')
+			field += '"';
+		field += c;
+	}
+	return field + "\"";
+}
+
+// Escape a string for a JSON string literal
+static std::string JsonString(std::string const& text) {
+	std::ostringstream out;
+	out << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if ((unsigned char)c < 0x20)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else
+			out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+// Hash as 16 hex digits
+static std::string HashString(uint64_t hash) {
+	std::ostringstream out;
+	out << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return out.str();
+}
+
+void Batch::WriteCsv(std::ostream& out) const {
+	out << "rom,variant,keys,seed,frames,instructions,skipped,unknown_opcodes,hash,exited,seconds,error\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		BatchJob const& job = jobs[i];
+		BatchResult const& result = results[i];
+		out << CsvField(job.rom) << "," << job.variant << "," << CsvField(job.keys) << "," << job.seed << ","
+			<< result.frames << "," << result.instructions << "," << result.skipped << "," << result.unknownOpcodes << ","
+			<< HashString(result.hash) << "," << (result.exited ? 1 : 0) << "," << result.seconds << ","
+			<< CsvField(result.error) << "\n";
+	}
+}
+
+void Batch::WriteJson(std::ostream& out) const {
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		BatchJob const& job = jobs[i];
+		BatchResult const& result = results[i];
+		out << "  {\"rom\": " << JsonString(job.rom) << ", \"variant\": " << JsonString(job.variant)
+			<< ", \"keys\": " << JsonString(job.keys) << ", \"seed\": " << job.seed
+			<< ", \"frames\": " << result.frames << ", \"instructions\": " << result.instructions
+			<< ", \"skipped\": " << result.skipped << ", \"unknown_opcodes\": " << result.unknownOpcodes
+			<< ", \"hash\": \"" << HashString(result.hash) << "\", \"exited\": " << (result.exited ? "true" : "false")
+			<< ", \"seconds\": " << result.seconds << ", \"error\": " << JsonString(result.error) << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "]\n";
+}
+
+size_t Batch::jobCount() const { return jobs.size(); }
+
+unsigned int Batch::threadsUsed() const { return threads; }
+
+uint64_t Batch::stealCount() const { return steals; }
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CPU.h"
+#include "InputScript.h"
+
+// One run of a batch: a ROM with a variant, an optional input script and a budget
+struct BatchJob {
+	std::string rom;
+	std::string variant = RuntimeQuirks::name;
+	std::string keys; // Input script, empty for none
+	uint32_t frames = 600; // Frame budget
+	uint64_t cycles = 0; // Instruction budget, 0 for none
+	uint32_t instructionsPerFrame = cst::INSTRUCTIONS_PER_FRAME;
+	uint32_t seed = 1;
+	bool jit = false; // Run through the JIT (x86-64) instead of the interpreter
+};
+
+struct BatchResult {
+	std::string error; // Empty if the job ran
+	uint32_t frames = 0;
+	uint64_t instructions = 0; // Including the skipped idle loop instructions
+	uint64_t skipped = 0;
+	uint64_t unknownOpcodes = 0;
+	uint64_t hash = 0; // Hash of the last frame
+	bool exited = false; // The ROM exited (00FD) before the budget ran out
+	double seconds = 0;
+};
+
+// Runs many headless instances across a work-stealing pool. ROMs and input scripts are loaded once
+// and shared read-only by every job using them.
+//
+// Job file lines are "<rom> [key=value]...", '#' starts a comment. Keys: variant, keys (input script),
+// frames, cycles, ipf, seed, jit (0 or 1). Relative paths are taken from the working directory.
+class Batch {
+public:
+	bool Load(char const* jobFileName); // Returns false if the file, a ROM or a script can't be loaded
+	void Run(unsigned int threadCount); // 0: one thread per hardware thread
+
+	void WriteCsv(std::ostream& out) const;
+	void WriteJson(std::ostream& out) const;
+
+	size_t jobCount() const;
+	unsigned int threadsUsed() const;
+	uint64_t stealCount() const;
+private:
+	BatchResult RunJob(BatchJob const& job) const;
+
+	std::vector<BatchJob> jobs;
+	std::vector<BatchResult> results; // By job index
+	std::map<std::string, std::vector<uint8_t>> roms;
+	std::map<std::string, InputScript> scripts;
+	unsigned int threads = 0;
+	uint64_t steals = 0;
+};
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "Batch.h"
+
+// chipei-batch: run a job file across all cores and report one line per job
+int main(int argc, char** argv) {
+	unsigned int threadCount = 0;
+	char const* csvFileName = nullptr;
+	char const* jsonFileName = nullptr;
+	char const* jobFileName = nullptr;
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option = argv[arg];
+		if (option == "--threads" && arg + 1 < argc) {
+			try {
+				threadCount = std::stoul(argv[++arg]);
+			} catch (std::exception const&) {
+				jobFileName = nullptr;
+				break;
+			}
+		} else if (option == "--csv" && arg + 1 < argc) {
+			csvFileName = argv[++arg];
+		} else if (option == "--json" && arg + 1 < argc) {
+			jsonFileName = argv[++arg];
+		} else if (option.rfind("--", 0) != 0 && !jobFileName) {
+			jobFileName = argv[arg];
+		} else {
+			jobFileName = nullptr;
+			break;
+		}
+	}
+
+	if (!jobFileName) {
+		std::cerr << "Usage: " << argv[0] << " <Jobs> [--threads <N>] [--csv <Out>] [--json <Out>]\n";
+		std::cerr << "Job lines: <ROM> [variant=<Name>] [keys=<Script>] [frames=<N>] [cycles=<N>] [ipf=<N>] [seed=<N>] [jit=<0|1>]\n";
+		std::cerr << "Writes CSV to stdout when neither --csv nor --json is given.\n";
+		return EXIT_FAILURE;
+	}
+
+	Batch batch;
+	if (!batch.Load(jobFileName))
+		return EXIT_FAILURE;
+
+	auto start = std::chrono::steady_clock::now();
+	batch.Run(threadCount);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (csvFileName) {
+		std::ofstream out(csvFileName);
+		batch.WriteCsv(out);
+	}
+	if (jsonFileName) {
+		std::ofstream out(jsonFileName);
+		batch.WriteJson(out);
+	}
+	if (!csvFileName && !jsonFileName)
+		batch.WriteCsv(std::cout);
+
+	std::cerr << batch.jobCount() << " jobs in " << seconds << " s on " << batch.threadsUsed() << " threads ("
+		<< batch.stealCount() << " steals)\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include "Benchmark.h"
+#include "CPU.h"
+#include "JIT.h"
+#include "LaneCPU.h"
+#include "Rewind.h"
+
+// Print the achieved instructions/second of one engine
+static void Report(char const* engine, uint64_t instructions, double seconds) {
+	std::cout << std::dec << engine << ": " << instructions << " instructions in " << seconds << " s, "
+		<< (uint64_t)(instructions / seconds) << " instructions/s" << std::endl;
+}
+
+int BenchmarkDispatch(char const* romFileName, uint32_t instructions) {
+	// Handler table, one Cycle() call per instruction
+	{
+		CPU chip8;
+		chip8.LoadROM(romFileName);
+		chip8.reportUnknownOpcodes = false;
+		if (!chip8.isRomLoaded())
+			return EXIT_FAILURE;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < instructions; ++i) {
+			chip8.Cycle();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("Cycle", instructions, std::chrono::duration<double>(end - start).count());
+	}
+
+	// Table-driven engine in one batch: the switch, then computed-goto threading where the compiler has it.
+	// Same handlers and fetch, so the difference is the dispatch branch alone.
+	{
+		CPU chip8;
+		chip8.LoadROM(romFileName);
+		chip8.reportUnknownOpcodes = false;
+		chip8.switchDispatch = true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		chip8.RunCycles(instructions);
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("RunCycles switch", instructions, std::chrono::duration<double>(end - start).count());
+	}
+#if defined(__GNUC__)
+	{
+		CPU chip8;
+		chip8.LoadROM(romFileName);
+		chip8.reportUnknownOpcodes = false;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		chip8.RunCycles(instructions);
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("RunCycles goto", instructions, std::chrono::duration<double>(end - start).count());
+	}
+#else
+	std::cout << "RunCycles goto: not available with this compiler" << std::endl;
+#endif
+
+	// Table-driven engine in 60 Hz frames of 1000 instructions
+	{
+		CPU chip8;
+		chip8.LoadROM(romFileName);
+		chip8.reportUnknownOpcodes = false;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		uint32_t executed = 0;
+		while (executed < instructions) {
+			executed += chip8.RunFrame(1000);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("RunFrame", executed, std::chrono::duration<double>(end - start).count());
+	}
+
+	// Native blocks from the JIT in the same frames, interpreting whatever it cannot translate
+	if (JIT::isSupported()) {
+		CPU chip8;
+		chip8.LoadROM(romFileName);
+		chip8.reportUnknownOpcodes = false;
+		chip8.tickTimersPerCycle = false;
+		JIT jit;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		uint32_t executed = 0;
+		while (executed < instructions) {
+			executed += jit.RunFrame(chip8, 1000);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("JIT", executed, std::chrono::duration<double>(end - start).count());
+	}
+	return EXIT_SUCCESS;
+}
+
+// Run a ROM on laneCount scalar CPUs and on one LaneCPU, report both and check every lane against its CPU
+static int CompareLanes(char const* name, std::vector<uint8_t> const& rom, uint32_t laneCount, uint32_t instructions, char const* variantName) {
+	std::cout << name << std::endl;
+
+	// A different seed and key in every lane, so that lanes diverge like an input sweep
+	std::vector<std::unique_ptr<CPU>> cpus;
+	for (uint32_t lane = 0; lane < laneCount; ++lane) {
+		std::unique_ptr<CPU> cpu = CPU::Create(variantName);
+		if (!cpu) {
+			std::cerr << "Unknown variant: " << variantName << "\n";
+			return EXIT_FAILURE;
+		}
+		cpu->reportUnknownOpcodes = false;
+		cpu->Seed(lane + 1);
+		cpu->LoadROM(rom.data(), rom.size());
+		cpu->keypad[lane % cst::KEY_COUNT] = 1;
+		cpus.push_back(std::move(cpu));
+	}
+
+	std::unique_ptr<LaneCPU> lanes = LaneCPU::Create(variantName, laneCount);
+	lanes->LoadROM(rom.data(), rom.size());
+	for (uint32_t lane = 0; lane < laneCount; ++lane) {
+		lanes->Seed(lane, lane + 1);
+		lanes->keypad(lane)[lane % cst::KEY_COUNT] = 1;
+	}
+
+	uint64_t total = (uint64_t)laneCount * instructions;
+
+	// Independent scalar CPUs, one Cycle() call per instruction
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (std::unique_ptr<CPU>& cpu : cpus) {
+			for (uint32_t i = 0; i < instructions; ++i) {
+				cpu->Cycle();
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("Cycle", total, std::chrono::duration<double>(end - start).count());
+	}
+
+	// Lockstep lanes
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		lanes->RunCycles(instructions);
+		auto end = std::chrono::high_resolution_clock::now();
+		Report("LaneCPU", total, std::chrono::duration<double>(end - start).count());
+		std::cout << "  " << lanes->vectorInstructions() << " vector, " << lanes->scalarInstructions() << " scalar lane instructions" << std::endl;
+	}
+
+	int result = EXIT_SUCCESS;
+	for (uint32_t lane = 0; lane < laneCount; ++lane) {
+		if (!lanes->SameState(lane, *cpus[lane])) {
+			std::cout << "Lane " << lane << ": MISMATCH" << std::endl;
+			result = EXIT_FAILURE;
+		}
+	}
+	if (result == EXIT_SUCCESS)
+		std::cout << laneCount << " lanes match their CPUs" << std::endl;
+	return result;
+}
+
+int BenchmarkLanes(char const* romFileName, uint32_t laneCount, uint32_t instructions, char const* variantName) {
+	std::ifstream file(romFileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	int result = CompareLanes(romFileName, rom, laneCount, instructions, variantName);
+
+	// A loop that diverges every lane for good: random stores (Cxkk, Fx33, Fx55) leave the memories
+	// different, key skips (ExA1) and a countdown of random length leave every lane at its own PC
+	uint16_t const code[] = {
+		0xA300, // 200: I = 300
+		0xC0FF, // 202: V0 = random
+		0xC10F, // 204: V1 = random & 0F
+		0xF033, // 206: BCD of V0 at I
+		0xF255, // 208: store V0..V2 at I
+		0xE0A1, // 20A: skip if key V0 isn't pressed
+		0x7201, // 20C: V2 += 1
+		0x71FF, // 20E: V1 -= 1
+		0x3100, // 210: skip if V1 == 0
+		0x120E, // 212: jump 20E
+		0xC3FF, // 214: V3 = random
+		0x8034, // 216: V0 += V3
+		0xE1A1, // 218: skip if key V1 isn't pressed
+		0x7301, // 21A: V3 += 1
+		0xF133, // 21C: BCD of V1 at I
+		0xC47F, // 21E: V4 = random & 7F
+		0x8242, // 220: V2 &= V4
+		0xF355, // 222: store V0..V3 at I
+		0xA300, // 224: I = 300
+		0x7501, // 226: V5 += 1
+		0x1202, // 228: jump 202
+	};
+	std::vector<uint8_t> divergent;
+	for (uint16_t instruction : code) {
+		divergent.push_back(instruction >> 8);
+		divergent.push_back(instruction & 0xFF);
+	}
+	if (CompareLanes("Divergent loop", divergent, laneCount, instructions, variantName) != EXIT_SUCCESS)
+		result = EXIT_FAILURE;
+	return result;
+}
+
+int BenchmarkDraw(uint32_t draws) {
+	// Draw loops: one sprite per 4 instructions, moving by odd steps so every alignment is hit
+	struct DrawLoop {
+		char const* name;
+		uint16_t mode; // 00FE (low res) or 00FF (high res)
+		uint16_t draw;
+	};
+	DrawLoop const loops[] = {
+		{ "low res 8x15", 0x00FE, 0xD01F },
+		{ "high res 8x15", 0x00FF, 0xD01F },
+		{ "high res 16x16", 0x00FF, 0xD010 },
+	};
+
+	for (DrawLoop const& loop : loops) {
+		for (char const* variantName : { SChipQuirks::name, RuntimeQuirks::name }) {
+			uint16_t const code[] = { loop.mode, 0xA300, loop.draw, 0x7007, 0x7103, 0x1204 };
+			std::vector<uint8_t> rom(0x120);
+			for (size_t i = 0; i < sizeof(code) / sizeof(code[0]); ++i) {
+				rom[i * 2] = code[i] >> 8;
+				rom[i * 2 + 1] = code[i] & 0xFF;
+			}
+			for (size_t i = 0x100; i < rom.size(); ++i) {
+				rom[i] = (uint8_t)(i * 0x9D);
+			}
+
+			std::unique_ptr<CPU> cpu = CPU::Create(variantName);
+			cpu->LoadROM(rom.data(), rom.size());
+			cpu->RunCycles(2);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			cpu->RunCycles(draws * 4);
+			auto end = std::chrono::high_resolution_clock::now();
+			double seconds = std::chrono::duration<double>(end - start).count();
+			std::cout << std::dec << loop.name << " (" << variantName << (cpu->quirks().clipSprites ? ", clipped" : ", wrapped")
+				<< "): " << draws << " draws in " << seconds << " s, " << (uint64_t)(draws / seconds) << " draws/s" << std::endl;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+// Run seconds * 3 of frames (so the window wraps) recording each, then step back from the newest frame to
+// each frame of the window in turn, restoring the recording before every step
+int BenchmarkRewind(char const* romFileName, uint32_t seconds, size_t bufferBytes) {
+	std::unique_ptr<CPU> cpu = CPU::Create(RuntimeQuirks::name);
+	cpu->reportUnknownOpcodes = false;
+	cpu->Seed(1);
+	cpu->LoadROM(romFileName);
+	if (!cpu->isRomLoaded())
+		return EXIT_FAILURE;
+
+	uint32_t const frames = seconds * cst::FRAMES_PER_SECOND;
+	Rewind rewind(frames, bufferBytes);
+	std::unique_ptr<CPU::State> state(new CPU::State());
+	double recordSeconds = 0;
+	for (uint32_t frame = 0; frame < frames * 3; ++frame) {
+		cpu->RunFrame(cst::INSTRUCTIONS_PER_FRAME);
+		auto start = std::chrono::high_resolution_clock::now();
+		cpu->SaveState(*state);
+		rewind.Push(*state);
+		recordSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	uint32_t const held = rewind.frameCount();
+	std::cout << std::dec << held << " of " << frames << " frames held in " << rewind.storedBytes() << " of " << bufferBytes
+		<< " bytes (" << rewind.storedBytes() / (held ? held : 1) << " bytes/frame), " << recordSeconds / (frames * 3) * 1e6
+		<< " us to record a frame" << std::endl;
+
+	// Each step back drops frames, so the window is restored from a copy first
+	double worst = 0;
+	double total = 0;
+	for (uint32_t back = 1; back < held; ++back) {
+		Rewind copy = rewind;
+		auto start = std::chrono::high_resolution_clock::now();
+		copy.StepBack(back, *state);
+		cpu->LoadState(*state);
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		worst = std::max(worst, seconds);
+		total += seconds;
+	}
+	std::cout << "Step back and load: " << total / (held > 1 ? held - 1 : 1) * 1e6 << " us on average, " << worst * 1e6
+		<< " us at worst" << std::endl;
+	return EXIT_SUCCESS;
+}
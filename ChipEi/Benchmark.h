@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Compare instructions/second of the Cycle() loop, the switch and computed-goto RunCycles() engines, RunFrame() and the JIT
+int BenchmarkDispatch(char const* romFileName, uint32_t instructions);
+
+// Compare aggregate instructions/second of laneCount independent CPUs against one LaneCPU running them
+// in lockstep, on the ROM and on a built-in loop that diverges every lane, and check that every lane
+// ends in the same state as its CPU
+int BenchmarkLanes(char const* romFileName, uint32_t laneCount, uint32_t instructions, char const* variantName);
+
+// Time sprite drawing (Dxyn in low and high res, Dxy0) with clipping and wrapping
+int BenchmarkDraw(uint32_t draws);
+
+// Record frames of a ROM into a Rewind window, then time stepping back to every frame it holds
+int BenchmarkRewind(char const* romFileName, uint32_t seconds, size_t bufferBytes);
\ No newline at end of file
@@ -1,5 +1,23 @@
 #include "CPU.h"
 
+// Instruction trace hooks, empty unless CHIPEI_TRACE is defined
+#if defined(CHIPEI_TRACE)
+#define CPU_TRACE_FETCH(address) traceAddress = address
+#define CPU_TRACE_RECORD() if (trace) trace->Record(traceAddress, opcode, index, inst->x, registers[inst->x])
+#else
+#define CPU_TRACE_FETCH(address)
+#define CPU_TRACE_RECORD()
+#endif
+
+// Profile hooks around each handler, empty unless CHIPEI_PROFILE is defined
+#if defined(CHIPEI_PROFILE)
+#define CPU_PROFILE_BEGIN(address) if (profile) profile->Begin((uint16_t)(address), inst->op)
+#define CPU_PROFILE_END() if (profile) profile->End()
+#else
+#define CPU_PROFILE_BEGIN(address)
+#define CPU_PROFILE_END()
+#endif
+
 uint8_t fontset[cst::FONTSET_SIZE] = {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -31,20 +49,66 @@ uint8_t fontset[cst::FONTSET_SIZE] = {
     0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C
 };
 
-CPU::CPU() : randGen(std::chrono::system_clock::now().time_since_epoch().count()) {
+// Every byte with each bit doubled (0x81 -> 0xC003), low res sprite rows are drawn 16 pixels wide
+static struct DoubledBytes {
+	uint16_t values[256];
+	DoubledBytes() {
+		for (unsigned int byte = 0; byte < 256; ++byte) {
+			values[byte] = 0;
+			for (unsigned int bit = 0; bit < 8; ++bit) {
+				if (byte & (1u << bit))
+					values[byte] |= 3u << (bit * 2);
+			}
+		}
+	}
+} const doubledBytes;
+
+// Decode table, handlers and dispatch engine of a quirk policy, built once on first use
+template <class Quirks>
+CPU::Variant const& CPU::VariantFor() {
+#define CPU_OPCODE_HANDLER(name) &CPU::OP_##name,
+#define CPU_QUIRK_HANDLER(name) &CPU::OP_##name<Quirks>,
+	static Variant const variant = {
+		Quirks::name,
+		OpTable(Quirks::extension),
+		{ CPU_OPCODES(CPU_OPCODE_HANDLER, CPU_QUIRK_HANDLER) },
+		&CPU::RunVariant<Quirks>,
+		&CPU::RunSwitch<Quirks>,
+		&Quirks::Get
+	};
+#undef CPU_QUIRK_HANDLER
+#undef CPU_OPCODE_HANDLER
+	return variant;
+}
+
+#define CPU_VARIANT_INSTANCE(policy) template CPU::Variant const& CPU::VariantFor<policy>();
+CPU_QUIRK_POLICIES(CPU_VARIANT_INSTANCE)
+#undef CPU_VARIANT_INSTANCE
+
+// Create the CPU of a variant by name ("chip8", "schip", ...), nullptr if there is none
+std::unique_ptr<CPU> CPU::Create(std::string const& variant) {
+#define CPU_CREATE_VARIANT(policy) \
+	if (variant == policy::name) \
+		return std::unique_ptr<CPU>(new BasicCPU<policy>());
+	CPU_QUIRK_POLICIES(CPU_CREATE_VARIANT)
+#undef CPU_CREATE_VARIANT
+	return nullptr;
+}
+
+// Default CPU: Super Chip-8 opcodes with the quirks taken from the experimental flags
+CPU::CPU() : CPU(VariantFor<RuntimeQuirks>()) {}
+
+CPU::CPU(Variant const& variant) : variant(&variant) {
 	// Set PC to start address
 	pc = cst::START_ADDRESS;
 
-	// Set current display video memory
-	current_video = video;
-
 	// Load fonts into memory
 	for (unsigned int i = 0; i < cst::FONTSET_SIZE; ++i) {
 		memory[cst::FONTSET_START_ADDRESS + i] = fontset[i];
 	}
 
 	// Initialize RNG
-	randByte = std::uniform_int_distribution<unsigned short int>(0, 255);
+	Seed((uint32_t)std::chrono::system_clock::now().time_since_epoch().count());
 }
 
 // Load the ROM file into memory.
@@ -63,35 +127,391 @@ void CPU::LoadROM(char const* filename) {
 		file.close();
 
 		// Load the ROM into memory
-		for (long i = 0; i < size; ++i) {
-			memory[cst::START_ADDRESS + i] = buffer[i];
-		}
+		LoadROM((uint8_t const*)buffer, (size_t)size);
 
 		// Clear the buffer
 		delete[] buffer;
-
-		_isRomLoaded = true;
 		return;
 	}
 	std::cout << "File failed to open." << std::endl;
 }
 
+// Load a ROM image that is already in memory (e.g. shared between many CPUs).
+void CPU::LoadROM(uint8_t const* data, size_t size) {
+	if (size > cst::MEMORY_SIZE - cst::START_ADDRESS) {
+		std::cout << "ROM too large." << std::endl;
+		return;
+	}
+	std::memcpy(memory + cst::START_ADDRESS, data, size);
+
+	// Drop decodes of the previous contents
+	InvalidateCode(0, cst::MEMORY_SIZE);
+
+	_isRomLoaded = true;
+}
+
+// Reseed the RNG for reproducible runs
+void CPU::Seed(uint32_t seed) {
+	random = seed ? seed : 1;
+}
+
+// Next random byte: xorshift32, a single word of state that save states copy as is
+uint8_t CPU::RandomByte() {
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	return (uint8_t)(random >> 24);
+}
+
 // Cycle: Fetch, Decode, Execute
 void CPU::Cycle() {
-	// Fetch: XX00 + 00XX
-	opcode = (memory[pc] << 8u) | memory[pc + 1];
+	Execute();
+	if (tickTimersPerCycle)
+		TickTimers();
+}
+
+// Run one instruction without ticking the timers
+void CPU::Execute() {
+	events = EVENT_NONE;
+
+	// Fetch and Decode (cached per address)
+	inst = &Fetch(pc);
+	opcode = inst->opcode;
+	CPU_TRACE_FETCH(pc);
 
 	// Increment PC
 	pc += 2;
 
-	// Decode and Execute
-	ParseOpcodes();
+	// Execute
+	CPU_PROFILE_BEGIN(pc - 2);
+	(this->*variant->handlers[inst->op])();
+	CPU_PROFILE_END();
+	CPU_TRACE_RECORD();
+}
+
+// SaveState: Copy the machine into state. The emulation settings (skipIdleLoops, ...) are not part of it.
+void CPU::SaveState(State& state) const {
+	state.magic = State::MAGIC;
+	state.version = State::VERSION;
+	state.reserved = 0;
+	state.size = sizeof(State);
+	std::memset(state.variant, 0, sizeof(state.variant));
+	std::strncpy(state.variant, variant->name, sizeof(state.variant) - 1);
+	std::memcpy(state.memory, memory, sizeof(memory));
+	std::memcpy(state.video, video, sizeof(video));
+	std::memcpy(state.stack, stack, sizeof(stack));
+	state.index = index;
+	state.pc = pc;
+	state.frameCycles = frameCycles;
+	state.random = random;
+	std::memcpy(state.registers, registers, sizeof(registers));
+	std::memcpy(state.userRegisters, userRegisters, sizeof(userRegisters));
+	std::memcpy(state.keypad, keypad, sizeof(keypad));
+	state.sp = sp;
+	state.delayTimer = delayTimer;
+	state.soundTimer = soundTimer;
+	state.extendedMode = extendedMode;
+	state.quit = quit;
+	state.loadFlag = experimental.load_flag;
+	state.shiftFlag = experimental.shift_flag;
+	state.dottedRenderingFlag = experimental.dotted_rendering_flag;
+}
+
+// Check that a state was saved by this version of the format and the same variant
+bool CPU::CanLoadState(State const& state) const {
+	return state.magic == State::MAGIC && state.version == State::VERSION && state.size == sizeof(State)
+		&& std::strncmp(state.variant, variant->name, sizeof(state.variant)) == 0;
+}
+
+// LoadState: Restore a state saved by the same variant. Only the memory blocks that differ are
+// invalidated, so the decoded and translated code of an unchanged program stays valid.
+bool CPU::LoadState(State const& state) {
+	if (!CanLoadState(state))
+		return false;
+
+	unsigned int const BLOCK = 64;
+	for (unsigned int address = 0; address < cst::MEMORY_SIZE; address += BLOCK) {
+		if (std::memcmp(memory + address, state.memory + address, BLOCK) != 0) {
+			std::memcpy(memory + address, state.memory + address, BLOCK);
+			InvalidateCode((uint16_t)address, BLOCK);
+		}
+	}
+	std::memcpy(video, state.video, sizeof(video));
+	std::memcpy(stack, state.stack, sizeof(stack));
+	index = state.index;
+	pc = state.pc;
+	frameCycles = state.frameCycles;
+	random = state.random ? state.random : 1;
+	std::memcpy(registers, state.registers, sizeof(registers));
+	std::memcpy(userRegisters, state.userRegisters, sizeof(userRegisters));
+	std::memcpy(keypad, state.keypad, sizeof(keypad));
+	sp = state.sp;
+	delayTimer = state.delayTimer;
+	soundTimer = state.soundTimer;
+	extendedMode = state.extendedMode;
+	quit = state.quit;
+	experimental.load_flag = state.loadFlag;
+	experimental.shift_flag = state.shiftFlag;
+	experimental.dotted_rendering_flag = state.dottedRenderingFlag;
+
+	events = EVENT_NONE;
+	idleLoop.armed = false;
+	dirtyRows = ~0ull;
+	return true;
+}
+
+// Write a state to a file, as is
+bool CPU::WriteState(State const& state, char const* fileName) {
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+	file.write((char const*)&state, sizeof(state));
+	return (bool)file;
+}
+
+// Read a state written by WriteState, LoadState checks that it fits
+bool CPU::ReadState(State& state, char const* fileName) {
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+	file.read((char*)&state, sizeof(state));
+	return file.gcount() == sizeof(state);
+}
+
+// RunCycles: Execute up to count instructions in one batch, without ticking the timers.
+// Stops early after an instruction that raises one of the stopOn events, returns the instructions executed.
+uint32_t CPU::RunCycles(uint32_t count, uint8_t stopOn) {
+	events = EVENT_NONE;
+	return (this->*(switchDispatch ? variant->runSwitch : variant->run))(count, stopOn);
+}
+
+// RunFrame: Execute the rest of the current frame and tick the 60 Hz timers once at its end.
+// A frame interrupted by a stopOn event is continued by the next call.
+// Idle loops and key waits are fast-forwarded: timers and keys only change between calls, so
+// they repeat until the frame ends. Returns the instructions executed, including skipped ones.
+uint32_t CPU::RunFrame(uint32_t instructionsPerFrame, uint8_t stopOn) {
+	return RunFrameUntil(instructionsPerFrame, instructionsPerFrame, stopOn);
+}
+
+// RunFrameUntil: Like RunFrame, but pause once the frame reaches cycle instructions, so keys can change
+// at that point. The timers tick when a call completes the frame.
+uint32_t CPU::RunFrameUntil(uint32_t instructionsPerFrame, uint32_t cycle, uint8_t stopOn) {
+	uint32_t const end = cycle < instructionsPerFrame ? cycle : instructionsPerFrame;
+	uint8_t const runStopOn = stopOn | (skipIdleLoops ? EVENT_LOOP | EVENT_KEY_WAIT : EVENT_NONE);
+	uint8_t raised = EVENT_NONE;
+	uint32_t executed = 0;
+
+	// Keys may have changed since the last call
+	idleLoop.armed = false;
+
+	while (frameCycles < end) {
+		uint32_t ran = RunCycles(end - frameCycles, runStopOn);
+		frameCycles += ran;
+		executed += ran;
+		raised |= events;
+		if (events & stopOn)
+			break;
+
+		// Skip whole iterations of the idle loop, the remainder runs normally
+		uint32_t remaining = end - frameCycles;
+		uint32_t skip = 0;
+		uint32_t stepped = 0;
+		if (events & EVENT_KEY_WAIT) {
+			skip = remaining;
+		} else if (events & EVENT_LOOP) {
+			skip = SkipIdleLoop(remaining, stepped);
+		}
+		frameCycles += stepped + skip;
+		executed += stepped + skip;
+		skipped += skip;
+	}
+
+	events = raised;
+	if (frameCycles >= instructionsPerFrame) {
+		frameCycles = 0;
+		TickTimers();
+		events |= EVENT_FRAME;
+	}
+	return executed;
+}
+
+// Instructions an idle loop body may hold: skips and computations on registers, I and the timers
+bool CPU::IsIdleOp(uint8_t op) {
+	switch (op) {
+		case ID_3xkk: case ID_4xkk: case ID_5xy0: case ID_9xy0: case ID_6xkk: case ID_7xkk:
+		case ID_8xy0: case ID_8xy1: case ID_8xy2: case ID_8xy3: case ID_8xy4: case ID_8xy5:
+		case ID_8xy6: case ID_8xy7: case ID_8xyE: case ID_Annn: case ID_Ex9E: case ID_ExA1:
+		case ID_Fx07: case ID_Fx1E: case ID_Fx29: case ID_Fx30:
+			return true;
+		default:
+			return false;
+	}
+}
 
-	// Decrement delay timer if it's been set
+// Check the loop closed by the 1nnn that just ran. A loop whose body only reads the timers and keys
+// and computes on registers, and that comes around again with the same registers, repeats until the
+// frame ends. Before skipping, one more pass is stepped (stepped instructions) to prove that it stays
+// in the body: a skip before the closing jump may leave it and other code may jump back in.
+// Returns the instructions to skip (whole passes), 0 while the loop is not known to be idle.
+uint32_t CPU::SkipIdleLoop(uint32_t remaining, uint32_t& stepped) {
+	stepped = 0;
+	if (inst == &scratch) {
+		idleLoop.armed = false;
+		return 0;
+	}
+	uint16_t jump = (uint16_t)((inst - decodeCache) * 2);
+	Instruction& closing = decodeCache[jump >> 1];
+
+	// Second pass with the same state: the loop may be idle
+	if (idleLoop.armed && idleLoop.jump == jump) {
+		if (idleLoop.index != index || std::memcmp(idleLoop.registers, registers, sizeof(registers)) != 0) {
+			// The first pass may still hold values read in the previous frame, a second change means
+			// the loop is making progress (counting, ...)
+			if (idleLoop.changed) {
+				closing.busy = true;
+				idleLoop.armed = false;
+				return 0;
+			}
+			idleLoop.changed = true;
+			idleLoop.position = frameCycles;
+			idleLoop.index = index;
+			std::memcpy(idleLoop.registers, registers, sizeof(registers));
+			return 0;
+		}
+
+		// A pass through the body runs each of its instructions at most once, a longer one ran other code
+		uint32_t length = frameCycles - idleLoop.position;
+		idleLoop.position = frameCycles;
+		if (length == 0 || length > (uint32_t)(jump - idleLoop.target) / 2 + 1u) {
+			idleLoop.armed = false;
+			return 0;
+		}
+		if (remaining < 2 * length)
+			return 0;
+
+		// The passes repeat from this state: step one, it must run forward through the body (skips
+		// only jump forward) to the closing jump and come back to the same state
+		idleLoop.armed = false;
+		while (stepped < length && pc >= idleLoop.target && pc < jump && IsIdleOp(Fetch(pc).op)) {
+			Execute();
+			++stepped;
+		}
+		if (stepped + 1 != length || pc != jump || Fetch(jump).op != ID_1nnn || Fetch(jump).nnn != idleLoop.target)
+			return 0;
+		Execute();
+		++stepped;
+		if (idleLoop.index != index || std::memcmp(idleLoop.registers, registers, sizeof(registers)) != 0)
+			return 0;
+		remaining -= stepped;
+		return remaining - remaining % length;
+	}
+
+	// First pass: the body must not have side effects other than on registers
+	idleLoop.armed = false;
+	for (uint16_t address = pc; address < jump; address += 2) {
+		if (!IsIdleOp(Fetch(address).op)) {
+			closing.busy = true;
+			return 0;
+		}
+	}
+
+	idleLoop.armed = true;
+	idleLoop.changed = false;
+	idleLoop.target = pc;
+	idleLoop.jump = jump;
+	idleLoop.position = frameCycles;
+	idleLoop.index = index;
+	std::memcpy(idleLoop.registers, registers, sizeof(registers));
+	return 0;
+}
+
+// Handlers that read or write PC. The threaded engine keeps PC in a local and only syncs it around these.
+constexpr bool CPU::UsesPc(OpId op) {
+	return op == ID_00EE || op == ID_1nnn || op == ID_2nnn || op == ID_3xkk || op == ID_4xkk || op == ID_5xy0
+		|| op == ID_9xy0 || op == ID_Bnnn || op == ID_Ex9E || op == ID_ExA1 || op == ID_Fx0A
+		|| op == ID_5xy1_E || op == ID_5xy2 || op == ID_5xy3;
+}
+
+// Table-driven dispatch engine, compiled once per quirk policy.
+// Uses computed-goto threading on GCC/Clang and the switch engine elsewhere.
+// PC and the instruction count live in locals, PC is stored back for the handlers that use it and on return.
+template <class Quirks>
+uint32_t CPU::RunVariant(uint32_t count, uint8_t stopOn) {
+#if defined(__GNUC__)
+	uint32_t executed = 0;
+	uint16_t address = pc;
+
+#define CPU_OPCODE_LABEL(name) &&L_##name,
+	static void* const labels[ID_COUNT] = { CPU_OPCODES(CPU_OPCODE_LABEL, CPU_OPCODE_LABEL) };
+#undef CPU_OPCODE_LABEL
+
+#define CPU_DISPATCH() \
+	do { \
+		if (executed == count || (events & stopOn)) { \
+			pc = address; \
+			return executed; \
+		} \
+		inst = &Fetch(address); \
+		opcode = inst->opcode; \
+		CPU_TRACE_FETCH(address); \
+		address += 2; \
+		++executed; \
+		goto *labels[inst->op]; \
+	} while (0)
+
+	CPU_DISPATCH();
+
+#define CPU_PC_IN(id) if (UsesPc(id)) pc = address;
+#define CPU_PC_OUT(id) if (UsesPc(id)) address = pc;
+#define CPU_OPCODE_CASE(name) L_##name: CPU_PC_IN(ID_##name) CPU_PROFILE_BEGIN(address - 2); OP_##name(); \
+	CPU_PROFILE_END(); CPU_PC_OUT(ID_##name) CPU_TRACE_RECORD(); CPU_DISPATCH();
+#define CPU_QUIRK_CASE(name) L_##name: CPU_PC_IN(ID_##name) CPU_PROFILE_BEGIN(address - 2); OP_##name<Quirks>(); \
+	CPU_PROFILE_END(); CPU_PC_OUT(ID_##name) CPU_TRACE_RECORD(); CPU_DISPATCH();
+	CPU_OPCODES(CPU_OPCODE_CASE, CPU_QUIRK_CASE)
+#undef CPU_QUIRK_CASE
+#undef CPU_OPCODE_CASE
+#undef CPU_PC_OUT
+#undef CPU_PC_IN
+#undef CPU_DISPATCH
+#else
+	return RunSwitch<Quirks>(count, stopOn);
+#endif
+}
+
+// Dispatch engine with one switch on the OpId per instruction, built on every compiler
+template <class Quirks>
+uint32_t CPU::RunSwitch(uint32_t count, uint8_t stopOn) {
+	uint32_t executed = 0;
+	while (executed < count && !(events & stopOn)) {
+		inst = &Fetch(pc);
+		opcode = inst->opcode;
+		CPU_TRACE_FETCH(pc);
+		pc += 2;
+		++executed;
+
+#define CPU_OPCODE_CASE(name) case ID_##name: OP_##name(); break;
+#define CPU_QUIRK_CASE(name) case ID_##name: OP_##name<Quirks>(); break;
+		CPU_PROFILE_BEGIN(pc - 2);
+		switch (inst->op) {
+			CPU_OPCODES(CPU_OPCODE_CASE, CPU_QUIRK_CASE)
+		}
+		CPU_PROFILE_END();
+#undef CPU_QUIRK_CASE
+#undef CPU_OPCODE_CASE
+		CPU_TRACE_RECORD();
+	}
+	return executed;
+}
+
+// Decrement the delay and sound timers if they've been set
+void CPU::TickTimers() {
 	if (delayTimer > 0)
 		--delayTimer;
 
-	// Decrement sound timer if it's been set
 	if (soundTimer > 0)
 		--soundTimer;
 }
@@ -105,188 +525,313 @@ bool CPU::isSoundPlaying() { return soundTimer > 0; }
 // Check if interpreter should close
 bool CPU::shouldClose() { return quit; }
 
-// Parse opcodes
-void CPU::ParseOpcodes() {
-	//std::cout << "Opcode: " << std::hex << opcode << std::endl;
-	
+// Events raised by the last Cycle, RunCycles or RunFrame
+uint8_t CPU::lastEvents() const { return events; }
+
+// Instructions fast-forwarded by idle loop detection
+uint64_t CPU::skippedInstructions() const { return skipped; }
+
+// Incorrect opcodes executed so far
+uint64_t CPU::unknownOpcodeCount() const { return unknownOpcodes; }
+
+// Name of the variant ("chip8", "schip", ...)
+char const* CPU::variantName() const { return variant->name; }
+
+#if defined(CHIPEI_PROFILE)
+// Names of the handlers, indexed by OpId
+std::vector<std::string> CPU::HandlerNames() {
+#define CPU_OPCODE_NAME(name) #name,
+	return { CPU_OPCODES(CPU_OPCODE_NAME, CPU_OPCODE_NAME) };
+#undef CPU_OPCODE_NAME
+}
+#endif
+
+// Quirks currently in effect
+QuirkSet CPU::quirks() const { return variant->quirks(experimental); }
+
+// Packed display rows, cst::VIDEO_ROW_WORDS words per row
+uint64_t const* CPU::display() const { return video[0]; }
+
+// Display rows changed since the last call (bit n for row n), then mark every row clean
+uint64_t CPU::TakeDirtyRows() {
+	uint64_t rows = dirtyRows;
+	dirtyRows = 0;
+	return rows;
+}
+
+// XOR a sprite row into the display with its left edge at (x, y), returns true if a lit pixel was erased.
+// The row is top-aligned in bits. Rows below and pixels right of the display wrap around unless clipped.
+bool CPU::DrawRow(unsigned int x, unsigned int y, uint64_t bits, bool clip) {
+	static_assert(cst::VIDEO_ROW_WORDS == 2, "DrawRow builds two-word row masks");
+	static_assert(cst::VIDEO_HEIGHT <= 64, "dirtyRows has one bit per row");
+	if (clip && y >= cst::VIDEO_HEIGHT)
+		return false;
+
+	// Shift the row into a 128-bit mask, the part past the last word wraps to the first one
+	unsigned int const shift = x % 64;
+	uint64_t const head = bits >> shift;
+	uint64_t const tail = shift ? bits << (64 - shift) : 0;
+	uint64_t const left = x < 64 ? head : (clip ? 0 : tail);
+	uint64_t const right = x < 64 ? tail : head;
+
+	uint64_t* row = video[y % cst::VIDEO_HEIGHT];
+	dirtyRows |= 1ull << (y % cst::VIDEO_HEIGHT);
+	bool const collision = ((row[0] & left) | (row[1] & right)) != 0;
+	row[0] ^= left;
+	row[1] ^= right;
+	return collision;
+}
+
+// Resolve the handler of an opcode for an extension, unmatched sub-opcodes go to OP_NULL
+CPU::OpId CPU::Resolve(uint16_t opcode, Extension extension) {
+	bool const schip = extension == Extension::SChip;
+	bool const chip8x = extension == Extension::Chip8X;
+	bool const chip8e = extension == Extension::Chip8E;
+
 	switch(opcode >> 12) {
 		// Opcodes starting with $0
 		case (0x0):
-			if ((opcode & 0x00F0u) == 0xB0) {
-				CPU::OP_00Bn(); // SuperChip-8
-				break;
-			} else if ((opcode & 0x00F0u) == 0xC0) {
-				CPU::OP_00Cn(); // SuperChip-8
-				break;
+			if (schip && (opcode & 0x00F0u) == 0xB0) {
+				return ID_00Bn; // SuperChip-8
+			} else if (schip && (opcode & 0x00F0u) == 0xC0) {
+				return ID_00Cn; // SuperChip-8
+			} else if (chip8x && opcode == 0x02A0) {
+				return ID_02A0; // Chip-8X
 			}
 
 			switch (opcode & 0x00FFu) {
 				case (0xE0):
-					CPU::OP_00E0();
-					break;
+					return ID_00E0;
 				case (0xEE):
-					CPU::OP_00EE();
-					break;
+					return ID_00EE;
+			}
+			if (!schip)
+				break;
+
+			switch (opcode & 0x00FFu) {
 				case (0xFB):
-					CPU::OP_00FB(); // SuperChip-8
-					break;
+					return ID_00FB; // SuperChip-8
 				case (0xFC):
-					CPU::OP_00FC(); // SuperChip-8
-					break;
+					return ID_00FC; // SuperChip-8
 				case (0xFD):
-					CPU::OP_00FD(); // SuperChip-8
-					break;
+					return ID_00FD; // SuperChip-8
 				case (0xFE):
-					CPU::OP_00FE(); // SuperChip-8
-					break;
+					return ID_00FE; // SuperChip-8
 				case (0xFF):
-					CPU::OP_00FF(); // SuperChip-8
-					break;
+					return ID_00FF; // SuperChip-8
 			}
 			break;
 		// Opcodes starting with $1
 		case (0x1):
-			CPU::OP_1nnn();
-			break;
+			return ID_1nnn;
 		// Opcodes starting with $2
 		case (0x2):
-			CPU::OP_2nnn();
-			break;
+			return ID_2nnn;
 		// Opcodes starting with $3
 		case (0x3):
-			CPU::OP_3xkk();
-			break;
+			return ID_3xkk;
 		// Opcodes starting with $4
 		case (0x4):
-			CPU::OP_4xkk();
-			break;
+			return ID_4xkk;
 		// Opcodes starting with $5
 		case (0x5):
-			CPU::OP_5xy0();
-			break;
+			if (chip8x && (opcode & 0x000Fu) == 0x1) {
+				return ID_5xy1; // Chip-8X
+			} else if (chip8e && (opcode & 0x000Fu) == 0x1) {
+				return ID_5xy1_E; // Chip-8E
+			} else if (chip8e && (opcode & 0x000Fu) == 0x2) {
+				return ID_5xy2; // Chip-8E
+			} else if (chip8e && (opcode & 0x000Fu) == 0x3) {
+				return ID_5xy3; // Chip-8E
+			}
+			return ID_5xy0;
 		// Opcodes starting with $6
 		case (0x6):
-			CPU::OP_6xkk();
-			break;
+			return ID_6xkk;
 		// Opcodes starting with $7
 		case (0x7):
-			CPU::OP_7xkk();
-			break;
+			return ID_7xkk;
 		// Opcodes starting with $8
 		case (0x8):
 			switch (opcode & 0x000F) {
 				case (0x0):
-					CPU::OP_8xy0();
-					break;
+					return ID_8xy0;
 				case (0x1):
-					CPU::OP_8xy1();
-					break;
+					return ID_8xy1;
 				case (0x2):
-					CPU::OP_8xy2();
-					break;
+					return ID_8xy2;
 				case (0x3):
-					CPU::OP_8xy3();
-					break;
+					return ID_8xy3;
 				case (0x4):
-					CPU::OP_8xy4();
-					break;
+					return ID_8xy4;
 				case (0x5):
-					CPU::OP_8xy5();
-					break;
+					return ID_8xy5;
 				case (0x6):
-					CPU::OP_8xy6();
-					break;
+					return ID_8xy6;
 				case (0x7):
-					CPU::OP_8xy7();
-					break;
+					return ID_8xy7;
 				case (0xE):
-					CPU::OP_8xyE();
-					break;
+					return ID_8xyE;
 			}
 			break;
 		// Opcodes starting with $9
 		case (0x9):
-			CPU::OP_9xy0();
-			break;
+			if (chip8e && (opcode & 0x000Fu) == 0x1) {
+				return ID_9xy1; // Chip-8E
+			} else if (chip8e && (opcode & 0x000Fu) == 0x2) {
+				return ID_9xy2; // Chip-8E
+			} else if (chip8e && (opcode & 0x000Fu) == 0x3) {
+				return ID_9xy3; // Chip-8E
+			}
+			return ID_9xy0;
 		// Opcodes starting with $A
 		case (0xA):
-			CPU::OP_Annn();
-			break;
+			return ID_Annn;
 		// Opcodes starting with $B
 		case (0xB):
-			CPU::OP_Bnnn();
-			break;
+			if (chip8x) {
+				return (opcode & 0x000Fu) == 0 ? ID_Bxy0 : ID_Bxyn; // Chip-8X
+			}
+			return ID_Bnnn;
 		// Opcodes starting with $C
 		case (0xC):
-			CPU::OP_Cxkk();
-			break;
+			return ID_Cxkk;
 		// Opcodes starting with $D
 		case (0xD):
-			if ((opcode & 0x000Fu) == 0) {
-				CPU::OP_Dxy0();
+			if (schip && (opcode & 0x000Fu) == 0) {
+				return ID_Dxy0; // SuperChip-8
 			} else {
-				CPU::OP_Dxyn(); // SuperChip-8
+				return ID_Dxyn;
 			}
-			break;
 		// Opcodes starting with $E
 		case (0xE):
-			if ((opcode & 0x000Fu) == 0x1) {
-				CPU::OP_ExA1();
+			if (chip8x && (opcode & 0x00FFu) == 0xF2) {
+				return ID_ExF2; // Chip-8X
+			} else if (chip8x && (opcode & 0x00FFu) == 0xF5) {
+				return ID_ExF5; // Chip-8X
+			} else if ((opcode & 0x000Fu) == 0x1) {
+				return ID_ExA1;
 			} else if ((opcode & 0x000Fu) == 0xE) {
-				CPU::OP_Ex9E();
+				return ID_Ex9E;
 			}
 			break;
 		// Opcodes starting with $F
 		case (0xF):
 			switch(opcode & 0x00FFu) {
 				case (0x07):
-					CPU::OP_Fx07();
-					break;
+					return ID_Fx07;
 				case (0x0A):
-					CPU::OP_Fx0A();
-					break;
+					return ID_Fx0A;
 				case (0x15):
-					CPU::OP_Fx15();
-					break;
+					return ID_Fx15;
 				case (0x18):
-					CPU::OP_Fx18();
-					break;
+					return ID_Fx18;
 				case (0x1E):
-					CPU::OP_Fx1E();
-					break;
+					return ID_Fx1E;
 				case (0x29):
-					CPU::OP_Fx29();
-					break;
-				case (0x30):
-					CPU::OP_Fx30(); // SuperChip-8
-					break;
+					return ID_Fx29;
 				case (0x33):
-					CPU::OP_Fx33();
-					break;
+					return ID_Fx33;
 				case (0x55):
-					CPU::OP_Fx55();
-					break;
+					return ID_Fx55;
 				case (0x65):
-					CPU::OP_Fx65();
-					break;
-				case (0x75):
-					CPU::OP_Fx75(); // SuperChip-8
-					break;
-				case (0x85):
-					CPU::OP_Fx85(); // SuperChip-8
-					break;
+					return ID_Fx65;
+			}
+
+			if (schip) {
+				switch (opcode & 0x00FFu) {
+					case (0x30):
+						return ID_Fx30; // SuperChip-8
+					case (0x75):
+						return ID_Fx75; // SuperChip-8
+					case (0x85):
+						return ID_Fx85; // SuperChip-8
+				}
+			} else if (chip8x) {
+				switch (opcode & 0x00FFu) {
+					case (0xF8):
+						return ID_FxF8; // Chip-8X
+					case (0xFB):
+						return ID_FxFB; // Chip-8X
+				}
+			} else if (chip8e) {
+				switch (opcode & 0x00FFu) {
+					case (0x75):
+						return ID_Fx75_E; // Chip-8E
+					case (0x94):
+						return ID_Fx94; // Chip-8E
+				}
 			}
 			break;
 		// Incorrect opcodes
 		default:
-			OP_NULL();
-			break;
+			return ID_NULL;
+	}
+	return ID_NULL;
+}
+
+// 64K-entry table per extension mapping every opcode to its handler, built once on first use
+uint8_t const* CPU::OpTable(Extension extension) {
+	typedef uint8_t Table[0x10000];
+	static Table const* const tables = [] {
+		static Table ops[(size_t)Extension::Count];
+		for (size_t ext = 0; ext < (size_t)Extension::Count; ++ext) {
+			for (uint32_t op = 0; op < 0x10000; ++op) {
+				ops[ext][op] = Resolve(op, (Extension)ext);
+			}
+		}
+		return ops;
+	}();
+	return tables[(size_t)extension];
+}
+
+// Decode an opcode into its handler and operand fields
+void CPU::Decode(Instruction& instruction, uint16_t opcode) const {
+	instruction.op = variant->ops[opcode];
+	instruction.opcode = opcode;
+	instruction.nnn = opcode & 0x0FFFu;
+	instruction.x = (opcode & 0x0F00u) >> 8u;
+	instruction.y = (opcode & 0x00F0u) >> 4u;
+	instruction.n = opcode & 0x000Fu;
+	instruction.kk = opcode & 0x00FFu;
+	instruction.valid = true;
+	instruction.busy = false;
+}
+
+// Fetch the decoded instruction at address, decoding it on a cache miss.
+// Only even addresses are cached, odd ones are decoded into a scratch entry.
+CPU::Instruction const& CPU::Fetch(uint16_t address) {
+	address &= cst::MEMORY_SIZE - 1;
+
+	Instruction& instruction = (address & 1u) ? scratch : decodeCache[address >> 1];
+	if (!instruction.valid || (address & 1u)) {
+		// Fetch: XX00 + 00XX
+		Decode(instruction, (memory[address] << 8u) | memory[(address + 1) & (cst::MEMORY_SIZE - 1)]);
 	}
+	return instruction;
 }
 
+// Invalidate cached decodes of instructions overlapping [address, address + length)
+void CPU::InvalidateCode(uint16_t address, uint16_t length) {
+	++storeCount;
+	lastStore = address;
+	lastStoreLength = length;
+
+	for (uint32_t i = address; i < (uint32_t)address + length; ++i) {
+		Instruction& instruction = decodeCache[(i & (cst::MEMORY_SIZE - 1)) >> 1];
+		instruction.valid = false;
+		if (instruction.watched)
+			codeModified = true;
+	}
+}
+
+
+
 // NULL: Opcodes that are incorrect
 void CPU::OP_NULL() {
-	std::cout << "Incorrect Opcode: " << std::hex << opcode << std::endl;
+	++unknownOpcodes;
+	if (reportUnknownOpcodes)
+		std::cout << "Incorrect Opcode: " << std::hex << opcode << std::endl;
 }
 
 /// Chip-8
@@ -294,8 +839,9 @@ void CPU::OP_NULL() {
 // CLS: Clear the display.
 //
 void CPU::OP_00E0() {
-	//std::fill_n(current_video, sizeof(current_video), 0);
-	memset(current_video, 0, sizeof(current_video));
+	memset(video, 0, sizeof(video));
+	dirtyRows = ~0ull;
+	events |= EVENT_DRAW;
 }
 
 // RET: Return from a subroutine.
@@ -305,23 +851,22 @@ void CPU::OP_00EE() {
 	pc = stack[sp];
 }
 
-// COMPAT: Non-standard. Toggles changing of the I register by save (FX55) and restore (FX65) opcodes.
-//
-void CPU::OP_00FA() {
-	experimental.load_flag = !experimental.load_flag;
-}
-
 // JP addr: Jump to location nnn.
 // The interpreter sets the program counter to nnn.
 void CPU::OP_1nnn() {
-	uint16_t address = opcode & 0x0FFFu;
+	uint16_t address = inst->nnn;
+
+	// A short jump backwards may close an idle loop
+	if (address < pc && (unsigned int)(pc - address) <= 2 * cst::IDLE_LOOP_LENGTH && !inst->busy)
+		events |= EVENT_LOOP;
+
 	pc = address;
 }
 
 // CALL addr: Call subroutine at nnn.
 // The interpreter increments the stack pointer, then puts the current PC on the top of the stack. The PC is then set to nnn.
 void CPU::OP_2nnn() {
-	uint16_t address = opcode & 0x0FFFu;
+	uint16_t address = inst->nnn;
 	stack[sp] = pc;
 	++sp;
 	pc = address;
@@ -330,8 +875,8 @@ void CPU::OP_2nnn() {
 // SE Vx, byte: Skip next instruction if Vx = kk.
 // The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
 void CPU::OP_3xkk() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+	uint8_t Vx = inst->x;
+	uint8_t byte = inst->kk;
 
 	if (registers[Vx] == byte)
 		pc += 2;
@@ -340,8 +885,8 @@ void CPU::OP_3xkk() {
 // SNE Vx, byte: Skip next instruction if Vx != kk.
 // The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
 void CPU::OP_4xkk() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+	uint8_t Vx = inst->x;
+	uint8_t byte = inst->kk;
 
 	if (registers[Vx] != byte)
 		pc += 2;
@@ -350,8 +895,8 @@ void CPU::OP_4xkk() {
 // SE Vx, Vy: Skip next instruction if Vx = Vy.
 // The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
 void CPU::OP_5xy0() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	if (registers[Vx] == registers[Vy])
 		pc += 2;
@@ -360,8 +905,8 @@ void CPU::OP_5xy0() {
 // LD Vx, byte: Set Vx = kk.
 // The interpreter puts the value kk into register Vx.
 void CPU::OP_6xkk() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+	uint8_t Vx = inst->x;
+	uint8_t byte = inst->kk;
 
 	registers[Vx] = byte;
 }
@@ -369,8 +914,8 @@ void CPU::OP_6xkk() {
 // ADD Vx, byte: Set Vx = Vx + kk.
 // Adds the value kk to the value of register Vx, then stores the result in Vx. 
 void CPU::OP_7xkk() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+	uint8_t Vx = inst->x;
+	uint8_t byte = inst->kk;
 
 	registers[Vx] += byte;
 }
@@ -378,8 +923,8 @@ void CPU::OP_7xkk() {
 // LD Vx, Vy: Set Vx = Vy.
 // Stores the value of register Vy in register Vx.
 void CPU::OP_8xy0() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[Vx] = registers[Vy];
 }
@@ -388,43 +933,55 @@ void CPU::OP_8xy0() {
 // Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx. 
 // A bitwise OR compares the corrseponding bits from two values, and if either bit is 1, 
 // then the same bit in the result is also 1. Otherwise, it is 0. 
+template <class Quirks>
 void CPU::OP_8xy1() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[Vx] |= registers[Vy];
+
+	if (Quirks::Get(experimental).logicResetsVF)
+		registers[cst::VF] = 0;
 }
 
 // AND Vx, Vy: Set Vx = Vx AND Vy.
 // Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx. 
 // A bitwise AND compares the corrseponding bits from two values, and if both bits are 1, 
 // then the same bit in the result is also 1. Otherwise, it is 0. 
+template <class Quirks>
 void CPU::OP_8xy2() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[Vx] &= registers[Vy];
+
+	if (Quirks::Get(experimental).logicResetsVF)
+		registers[cst::VF] = 0;
 }
 
 // XOR Vx, Vy: Set Vx = Vx XOR Vy.
 // Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx. 
 // An exclusive OR compares the corrseponding bits from two values, and if the bits are not both the same,
 // then the corresponding bit in the result is set to 1. Otherwise, it is 0.
+template <class Quirks>
 void CPU::OP_8xy3() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[Vx] ^= registers[Vy];
+
+	if (Quirks::Get(experimental).logicResetsVF)
+		registers[cst::VF] = 0;
 }
 
 // ADD Vx, Vy: Set Vx = Vx + Vy, set VF = carry.
 // The values of Vx and Vy are added together. If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. 
 // Only the lowest 8 bits of the result are kept, and stored in Vx.
 void CPU::OP_8xy4() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
-	uint8_t sum = registers[Vx] + registers[Vy];
+	unsigned int sum = registers[Vx] + registers[Vy];
 
 	registers[cst::VF] = sum > 255u ? 1 : 0;
 	registers[Vx] = sum & 0xFFu;
@@ -433,8 +990,8 @@ void CPU::OP_8xy4() {
 // SUB Vx, Vy: Set Vx = Vx - Vy, set VF = NOT borrow.
 // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
 void CPU::OP_8xy5() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[cst::VF] = registers[Vx] > registers[Vy] ? 1 : 0;
 	registers[Vx] -= registers[Vy];
@@ -442,12 +999,13 @@ void CPU::OP_8xy5() {
 
 // SHR Vx: Set Vx = Vx SHR 1.
 // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
+template <class Quirks>
 void CPU::OP_8xy6() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	uint8_t Vc = Vx;
 
-	if (experimental.shift_flag) {
-		uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	if (Quirks::Get(experimental).shiftUsesVy) {
+		uint8_t Vy = inst->y;
 		Vc = Vy;
 	}
 
@@ -461,8 +1019,8 @@ void CPU::OP_8xy6() {
 // SUBN Vx, Vy: Set Vx = Vy - Vx, set VF = NOT borrow.
 // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
 void CPU::OP_8xy7() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[cst::VF] = registers[Vy] > registers[Vx] ? 1 : 0;
 	registers[Vx] = registers[Vy] - registers[Vx];
@@ -470,12 +1028,13 @@ void CPU::OP_8xy7() {
 
 // SHL Vx {, Vy}: Set Vx = Vx SHL 1.
 // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
+template <class Quirks>
 void CPU::OP_8xyE() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	uint8_t Vc = Vx;
 
-	if (experimental.shift_flag) {
-		uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	if (Quirks::Get(experimental).shiftUsesVy) {
+		uint8_t Vy = inst->y;
 		Vc = Vy;
 	}
 
@@ -489,8 +1048,8 @@ void CPU::OP_8xyE() {
 // SNE Vx, Vy: Skip next instruction if Vx != Vy.
 // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
 void CPU::OP_9xy0() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	if (registers[Vx] != registers[Vy])
 		pc += 2;
@@ -499,110 +1058,79 @@ void CPU::OP_9xy0() {
 // LD I, addr: Set I = nnn.
 // The value of register I is set to nnn.
 void CPU::OP_Annn() {
-	uint16_t address = opcode & 0x0FFFu;
+	uint16_t address = inst->nnn;
 	index = address;
 }
 
 // JP V0, addr: Jump to location nnn + V0.
-// The program counter is set to nnn plus the value of V0.
+// The program counter is set to nnn plus the value of V0 (Chip-48 and SuperChip-8: xnn plus the value of Vx).
+template <class Quirks>
 void CPU::OP_Bnnn() {
-	uint16_t address = opcode & 0x0FFFu;
-	pc = address + registers[cst::V0];
+	uint16_t address = inst->nnn;
+	pc = address + registers[Quirks::Get(experimental).jumpUsesVx ? inst->x : cst::V0];
 }
 
 // RND Vx, byte: Set Vx = random byte AND kk.
 // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk. 
 // The results are stored in Vx. See instruction 8xy2 for more information on AND.
 void CPU::OP_Cxkk() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t byte = opcode & 0x00FFu;
+	uint8_t Vx = inst->x;
+	uint8_t byte = inst->kk;
 
-	registers[Vx] = randByte(randGen) & byte;
+	registers[Vx] = RandomByte() & byte;
 }
 
 // DRW Vx, Vy, nibble: Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
 // The interpreter reads n bytes from memory, starting at the address stored in I. 
 // These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. 
 // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0. 
-// If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen. 
+// If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen
+// (or is clipped, depending on the variant).
+template <class Quirks>
 void CPU::OP_Dxyn() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-	uint8_t height = opcode & 0x000Fu;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
+	uint8_t height = inst->n;
+	QuirkSet const quirks = Quirks::Get(experimental);
 
 	// Wrap if going beyond screen bounds
-	uint8_t xPos = (registers[Vx] * (2 - extendedMode)) % cst::VIDEO_WIDTH; // multiply with 2 if not in extended mode 
-	uint8_t yPos = (registers[Vy] * (2 - extendedMode)) % cst::VIDEO_HEIGHT; // multiply with 2 if not in extended mode 
-
-	// Reset VF
-	registers[cst::VF] = 0;
-
-	uint8_t sprite_size = cst::SPRITE_SIZE;
-
-	for (unsigned int row = 0; row < height; ++row) {
-		uint8_t spriteByte = memory[index + row];
-		for (unsigned int col = 0; col < sprite_size; ++col) {
-			uint8_t nxPos = xPos + (col * (2 - extendedMode)); 
-			uint8_t nyPos = yPos + (row * (2 - extendedMode));
-			nxPos = nxPos % cst::VIDEO_WIDTH; 
-			nyPos = nyPos % cst::VIDEO_HEIGHT;
-
-			uint8_t spritePixel = spriteByte & (0x80u >> col);
-
-			if (spritePixel) {
-				if (!extendedMode || experimental.dotted_rendering_flag) {
-					// If not in extended mode, 1x1 sprite pixel == 2x2 screen pixels
-					uint32_t* screenPixel1 = &current_video[nyPos * cst::VIDEO_WIDTH + nxPos];
-					uint32_t* screenPixel2 = &current_video[(nyPos + 1) * cst::VIDEO_WIDTH + nxPos];
-					uint32_t* screenPixel3 = &current_video[(nyPos + 1) * cst::VIDEO_WIDTH + (nxPos + 1)];
-					uint32_t* screenPixel4 = &current_video[nyPos * cst::VIDEO_WIDTH + (nxPos + 1)];
-					registers[cst::VF] = (*screenPixel1 == 0xFFFFFFFF) | (*screenPixel2 == 0xFFFFFFFF) | (*screenPixel3 == 0xFFFFFFFF) | (*screenPixel4 == 0xFFFFFFFF);
-
-					*screenPixel1 ^= 0xFFFFFFFF;
-					*screenPixel2 ^= 0xFFFFFFFF;
-					*screenPixel3 ^= 0xFFFFFFFF;
-					*screenPixel4 ^= 0xFFFFFFFF;
-				} else {
-					uint32_t* screenPixel = &current_video[nyPos * cst::VIDEO_WIDTH + nxPos];
-					registers[cst::VF] = *screenPixel == 0xFFFFFFFF;
-
-					*screenPixel ^= 0xFFFFFFFF;
-				}
-			}
+	unsigned int xPos = (registers[Vx] * (2 - extendedMode)) % cst::VIDEO_WIDTH; // multiply with 2 if not in extended mode
+	unsigned int yPos = (registers[Vy] * (2 - extendedMode)) % cst::VIDEO_HEIGHT; // multiply with 2 if not in extended mode
+
+	bool collision = false;
+	events |= EVENT_DRAW;
+
+	if (!extendedMode) {
+		// If not in extended mode, 1x1 sprite pixel == 2x2 screen pixels
+		for (unsigned int row = 0; row < height; ++row) {
+			uint64_t bits = (uint64_t)doubledBytes.values[memory[(index + row) % cst::MEMORY_SIZE]] << 48;
+			collision |= DrawRow(xPos, yPos + row * 2, bits, quirks.clipSprites);
+			collision |= DrawRow(xPos, yPos + row * 2 + 1, bits, quirks.clipSprites);
 		}
-	}
-	/*
-	// Loop over each row and column of the sprite
-	for (unsigned int row = 0; row < height; ++row) {
-		uint8_t spriteByte = memory[index + row];
-
-		for (unsigned int col = 0; col < sprite_size; ++col) {
-			uint8_t nxPos = xPos + col; 
-			uint8_t nyPos = yPos + row; 
-			nxPos = nxPos % cst::VIDEO_WIDTH; 
-			nyPos = nyPos % cst::VIDEO_HEIGHT;
-
-			uint8_t spritePixel = spriteByte & (0x80u >> col);
-			uint32_t* screenPixel = &current_video[nyPos * cst::VIDEO_WIDTH + nxPos];
-
-			// If sprite pixel is on
-			if (spritePixel) {
-				// Collision
-				if (*screenPixel == 0xFFFFFFFF) {
-					registers[cst::VF] = 1;
-				}
-
-				*screenPixel ^= 0xFFFFFFFF;
-			}
+	} else if (quirks.dottedRendering) {
+		// 2x2 screen pixels one pixel apart: each sprite pixel flips itself and its right, lower and
+		// lower right neighbours, so a screen row gets the XOR of two widened sprite rows
+		uint64_t previous = 0;
+		for (unsigned int row = 0; row <= height; ++row) {
+			uint64_t sprite = row < height ? (uint64_t)memory[(index + row) % cst::MEMORY_SIZE] << 56 : 0;
+			uint64_t bits = sprite ^ (sprite >> 1);
+			collision |= DrawRow(xPos, yPos + row, bits ^ previous, quirks.clipSprites);
+			previous = bits;
+		}
+	} else {
+		for (unsigned int row = 0; row < height; ++row) {
+			uint64_t bits = (uint64_t)memory[(index + row) % cst::MEMORY_SIZE] << 56;
+			collision |= DrawRow(xPos, yPos + row, bits, quirks.clipSprites);
 		}
 	}
-	*/
+
+	registers[cst::VF] = collision;
 }
 
 // SKP Vx: Skip next instruction if key with the value of Vx is pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
 void CPU::OP_Ex9E() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	uint8_t key = registers[Vx];
 
 	if (keypad[key])
@@ -612,7 +1140,7 @@ void CPU::OP_Ex9E() {
 // SKNP Vx: Skip next instruction if key with the value of Vx is not pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
 void CPU::OP_ExA1() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	uint8_t key = registers[Vx];
 
 	if (!keypad[key])
@@ -623,14 +1151,14 @@ void CPU::OP_ExA1() {
 // LD Vx, DT: Set Vx = delay timer value.
 // The value of DT is placed into Vx.
 void CPU::OP_Fx07() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	registers[Vx] = delayTimer;
 }
 
 // LD Vx, K: Wait for a key press, store the value of the key in Vx.
 // All execution stops until a key is pressed, then the value of that key is stored in Vx.
 void CPU::OP_Fx0A() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	uint8_t key = registers[Vx];
 
 	/*
@@ -711,33 +1239,34 @@ void CPU::OP_Fx0A() {
 		}
 	}
 	pc -= 2;
+	events |= EVENT_KEY_WAIT;
 }
 
 // LD DT, Vx: Set delay timer = Vx.
 // DT is set equal to the value of Vx.
 void CPU::OP_Fx15() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	delayTimer = registers[Vx];
 }
 
 // LD ST, Vx: Set sound timer = Vx.
 // ST is set equal to the value of Vx.
 void CPU::OP_Fx18() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	soundTimer = registers[Vx];
 }
 
 // ADD I, Vx: Set I = I + Vx.
 // The values of I and Vx are added, and the results are stored in I.
 void CPU::OP_Fx1E() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	index += registers[Vx];
 }
 
 // LD F, Vx: Set I = location of sprite for digit Vx.
 // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx.
 void CPU::OP_Fx29() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	uint8_t digit = registers[Vx];
 	index = cst::FONTSET_START_ADDRESS + (5 * digit);
@@ -747,7 +1276,7 @@ void CPU::OP_Fx29() {
 // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I, 
 // the tens digit at location I+1, and the ones digit at location I+2.
 void CPU::OP_Fx33() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	uint8_t value = registers[Vx];
 
@@ -761,30 +1290,36 @@ void CPU::OP_Fx33() {
 
 	// Hundreds-place
 	memory[index] = value % 10;
+
+	InvalidateCode(index, 3);
 }
 
 // LD [I], Vx: Store registers V0 through Vx in memory starting at location I.
 // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
+template <class Quirks>
 void CPU::OP_Fx55() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	for (uint8_t i = 0; i <= Vx; ++i) {
 		memory[index + i] = registers[i];
 	}
-	if (experimental.load_flag) {
+	InvalidateCode(index, Vx + 1);
+
+	if (Quirks::Get(experimental).loadIncrementsIndex) {
 		this->index += Vx + 1;
 	}
 }
 
 // LD Vx, [I]: Read registers V0 through Vx from memory starting at location I.
 // The interpreter reads values from memory starting at location I into registers V0 through Vx.
+template <class Quirks>
 void CPU::OP_Fx65() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	for (uint8_t i = 0; i <= Vx; ++i) {
 		registers[i] = memory[index + i];
 	}
 
-	if (experimental.load_flag) {
+	if (Quirks::Get(experimental).loadIncrementsIndex) {
 		this->index += Vx + 1;
 	}
 }
@@ -792,114 +1327,110 @@ void CPU::OP_Fx65() {
 /// SChip-8
 
 // SCU N: Scroll display N lines up.
-//
+// Distances are in pixels of the current mode, a low res line is two display rows.
 void CPU::OP_00Bn() {
-	uint8_t Vn = opcode & 0x000Fu;
+	unsigned int const rows = inst->n * (2 - extendedMode);
+	dirtyRows = ~0ull;
+	events |= EVENT_DRAW;
 
-	for (int row = 0; row <= Vn; row++){
-        for (int col = 0; col < 128; col++){
-            current_video[row * cst::VIDEO_WIDTH + col] = current_video[(row + Vn) * cst::VIDEO_WIDTH + col];
-        }
-    }
-
-    for (int row = 0; row < 128; row++){
-        for(int col = 0; col < Vn; col++){
-            current_video[row * cst::VIDEO_WIDTH + col] = 0;
-        }
-    }
+	memmove(video[0], video[rows], (cst::VIDEO_HEIGHT - rows) * sizeof(video[0]));
+	memset(video[cst::VIDEO_HEIGHT - rows], 0, rows * sizeof(video[0]));
 }
 
 // SCD N: Scroll display N lines down.
 //
 void CPU::OP_00Cn() {
-	uint8_t Vn = opcode & 0x000Fu;
-
-	for (int row = 63; row >= Vn; row--){
-        for (int col = 0; col < 128; col++){
-            current_video[row * cst::VIDEO_WIDTH + col] = current_video[(row - Vn) * cst::VIDEO_WIDTH + col];
-        }
-    }
+	unsigned int const rows = inst->n * (2 - extendedMode);
+	dirtyRows = ~0ull;
+	events |= EVENT_DRAW;
 
-    for (int row = 0; row < 128; row++){
-        for(int col = 0; col < Vn; col++){
-            current_video[row * cst::VIDEO_WIDTH + col] = 0;
-        }
-    }
+	memmove(video[rows], video[0], (cst::VIDEO_HEIGHT - rows) * sizeof(video[0]));
+	memset(video[0], 0, rows * sizeof(video[0]));
 }
 
 // SCR: Scroll display 4 pixels to the right.
-//
+// Each row is shifted word by word, carrying the bits that leave a word into the next one.
 void CPU::OP_00FB() {
-	// hmmm
+	unsigned int const shift = 4 * (2 - extendedMode);
+	dirtyRows = ~0ull;
+	events |= EVENT_DRAW;
+
+	for (uint64_t* row : video) {
+		for (unsigned int word = cst::VIDEO_ROW_WORDS - 1; word > 0; --word) {
+			row[word] = row[word] >> shift | row[word - 1] << (64 - shift);
+		}
+		row[0] >>= shift;
+	}
 }
 
 // SCL: Scroll display 4 pixels to the left.
 //
 void CPU::OP_00FC() {
-	// hmmm
+	unsigned int const shift = 4 * (2 - extendedMode);
+	dirtyRows = ~0ull;
+	events |= EVENT_DRAW;
+
+	for (uint64_t* row : video) {
+		for (unsigned int word = 0; word + 1 < cst::VIDEO_ROW_WORDS; ++word) {
+			row[word] = row[word] << shift | row[word + 1] >> (64 - shift);
+		}
+		row[cst::VIDEO_ROW_WORDS - 1] <<= shift;
+	}
 }
 
 // EXIT: Exit the interpreter.
 //
 void CPU::OP_00FD() {
 	quit = true;
+	events |= EVENT_EXIT;
 }
 
 // LOW: Enable low res (64x32) mode.
 //
 void CPU::OP_00FE() {
 	extendedMode = false;
+	dirtyRows = ~0ull;
 }
 
 // HIGH: Enable high res (128x64) mode.
 //
 void CPU::OP_00FF() {
 	extendedMode = true;
+	dirtyRows = ~0ull;
 }
 
 // DRW VX, VX, 0: When in high res mode show a 16x16 sprite at (VX, VY).
 //
+template <class Quirks>
 void CPU::OP_Dxy0() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
+	bool const clip = Quirks::Get(experimental).clipSprites;
 
 	if (!extendedMode)
 		return;
 
 	// Wrap if going beyond screen bounds
-	uint8_t xPos = registers[Vx] % cst::VIDEO_WIDTH;
-	uint8_t yPos = registers[Vy] % cst::VIDEO_HEIGHT;
+	unsigned int xPos = registers[Vx] % cst::VIDEO_WIDTH;
+	unsigned int yPos = registers[Vy] % cst::VIDEO_HEIGHT;
 
-	// Reset VF
-	registers[cst::VF] = 0;
+	bool collision = false;
+	events |= EVENT_DRAW;
 
-	uint8_t sprite_size = cst::SPRITE_SIZE * 2;
-
-	// Loop over each row and column of the sprite
-	for (unsigned int row = 0; row < sprite_size; ++row) {
-		uint8_t spriteByte = memory[index + row];
-
-		for (unsigned int col = 0; col < sprite_size; ++col) {
-			uint8_t spritePixel = spriteByte & (0x80u >> col);
-			uint32_t* screenPixel = &current_video[(yPos + row) * cst::VIDEO_WIDTH + (xPos + col)];
-
-			// If sprite pixel is on
-			if (spritePixel) {
-				// Collision
-				if (*screenPixel == 0xFFFFFFFF) {
-					registers[cst::VF] = 1;
-				}
-
-				*screenPixel ^= 0xFFFFFFFF;
-			}
-		}
+	// Each row is two bytes, left half first
+	for (unsigned int row = 0; row < cst::SPRITE_SIZE * 2; ++row) {
+		uint16_t address = index + row * 2;
+		uint64_t bits = (uint64_t)(memory[address % cst::MEMORY_SIZE] << 8 | memory[(address + 1) % cst::MEMORY_SIZE]) << 48;
+		collision |= DrawRow(xPos, yPos + row, bits, clip);
 	}
+
+	registers[cst::VF] = collision;
 }
 
 // LD I, FONT(VX): Set I to the address of the SCHIP-8 16x10 font sprite representing the value in VX.
 //
 void CPU::OP_Fx30() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	uint8_t digit = registers[Vx];
 	index = cst::FONTSET_START_ADDRESS + (10 * digit);
@@ -908,7 +1439,7 @@ void CPU::OP_Fx30() {
 // LD R, VX: Store V0 through VX to HP-48 RPL user flags (X <= 7).
 //
 void CPU::OP_Fx75() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	for (uint8_t i = 0; i <= Vx; ++i) {
 		userRegisters[index + i] = registers[i];
@@ -918,7 +1449,7 @@ void CPU::OP_Fx75() {
 // LD VX, R: Read V0 through VX to HP-48 RPL user flags (X <= 7)
 //
 void CPU::OP_Fx85() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 
 	for (uint8_t i = 0; i <= Vx; ++i) {
 		registers[i] = userRegisters[index + i];
@@ -938,8 +1469,8 @@ void CPU::OP_02A0() {
 // ADD VX, VY: Let VX = VX + VY (hex digits 00 to 77) 
 // (useful for manipulating the NH, NV parameters for low resolution color.)
 void CPU::OP_5xy1() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	// Set Color
 }
@@ -947,8 +1478,8 @@ void CPU::OP_5xy1() {
 // COL VX, VY: Set VY color at VX(NH), VX+1(NV) 
 // (provides low resolution color 8x8.)
 void CPU::OP_Bxy0() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	// Set Color
 }
@@ -956,9 +1487,9 @@ void CPU::OP_Bxy0() {
 // COL VX, VY, N: N != 0, set VY color at VX, VX+1 byte N bytes vertically 
 // (provides high resolution 8x32.)
 void CPU::OP_Bxyn() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-	uint8_t Vn = opcode & 0x000Fu;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
+	uint8_t Vn = inst->n;
 
 	// Set Color
 }
@@ -966,32 +1497,32 @@ void CPU::OP_Bxyn() {
 // SKP2 VX: Skip the following instruction if the key represented by the value in VX is pressed on hex keyboard 2.
 //
 void CPU::OP_ExF2() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 }
 
 // SKNP2 VX: Skip the following instruction if the key represented by the value in VX is not pressed on hex keyboard 2.
 //
 void CPU::OP_ExF5() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 }
 
 // IN VX: Copy contents from input port to VX. (Waits for EF4=1)
 //
 void CPU::OP_FxFB() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 }
 
 // OUT VX: Output contents of VX to output port. Used to program simple sound.
 //
 void CPU::OP_FxF8() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 }
 
 // SGT VX, VY: Skip the next instruction if register VX is greater than VY.
 //
 void CPU::OP_5xy1_E() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	if (registers[Vx] > registers[Vy])
 		pc += 2;
@@ -1000,8 +1531,8 @@ void CPU::OP_5xy1_E() {
 // SLT VX, VY: Skip the next instruction if register VX is less than VY.
 //
 void CPU::OP_5xy2() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	if (registers[Vx] < registers[Vy])
 		pc += 2;
@@ -1010,8 +1541,8 @@ void CPU::OP_5xy2() {
 // SNE VX, VY: Skip the next instruction if register VX does not equal VY.
 //
 void CPU::OP_5xy3() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	if (registers[Vx] != registers[Vy])
 		pc += 2;
@@ -1020,15 +1551,15 @@ void CPU::OP_5xy3() {
 // MUL VX, VY: Set VF, VX equal to VX multipled by VY where VF is the most significant byte of a 16bit word.
 //
 void CPU::OP_9xy1() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 }
 
 // DIV VX, VY: Set VX equal to VX divided by VY. VF is set to the remainder.
 //
 void CPU::OP_9xy2() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	registers[Vx] = registers[Vx] / registers[Vy];
 	registers[cst::VF] = registers[Vx] % registers[Vy];
@@ -1037,8 +1568,8 @@ void CPU::OP_9xy2() {
 // BCD VX, VY: Let VX, VY be treated as a 16bit word with VX the most significant part. 
 // Convert that word to BCD and store the 5 digits at memory location I through I+4. I does not change.
 void CPU::OP_9xy3() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = inst->x;
+	uint8_t Vy = inst->y;
 
 	uint16_t value = (registers[Vx] << 8u) | registers[Vy];
 
@@ -1060,18 +1591,20 @@ void CPU::OP_9xy3() {
 
 	// Ten-thousands-place
 	memory[index] = value % 10;
+
+	InvalidateCode(index, 5);
 }
 
 // DISP VX: Display the value of VX on the COSMAC Elf hex display.
 //
 void CPU::OP_Fx75_E() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	// Display value of Vx in UI
 }
 
 // LD I, VX: Load I with the address of the font sprite of the ASCII value found in VX.
 //
 void CPU::OP_Fx94() {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = inst->x;
 	index = registers[Vx];
 }
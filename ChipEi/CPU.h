@@ -1,9 +1,18 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <chrono>
 #include <iostream>
-#include <random>
+#include <memory>
+#include <string>
+#include "Quirks.h"
+#if defined(CHIPEI_TRACE)
+#include "Trace.h"
+#endif
+#if defined(CHIPEI_PROFILE)
+#include "Profiler.h"
+#endif
 
 namespace cst {
 	const unsigned int FONTSET_SIZE = 240; // Fontset Size
@@ -11,43 +20,182 @@ namespace cst {
 	const unsigned int FONTSET_START_ADDRESS = 0x50; // Fontset Start Address
 	const unsigned int VIDEO_WIDTH = 128;
 	const unsigned int VIDEO_HEIGHT = 64;
+	const unsigned int VIDEO_ROW_WORDS = VIDEO_WIDTH / 64; // 64-bit words per packed display row
 	const unsigned int MEMORY_SIZE = 4096;
 	const unsigned int REGISTER_COUNT = 16;
 	const unsigned int USER_RESISTER_COUNT = 8;
 	const unsigned int STACK_LEVELS = 16;
 	const unsigned int KEY_COUNT = 16;
 	const unsigned int SPRITE_SIZE = 8;
+	const unsigned int FRAMES_PER_SECOND = 60; // Timer and display refresh rate
+	const unsigned int INSTRUCTIONS_PER_FRAME = 11; // About 660 instructions per second at 60 Hz
+	const unsigned int IDLE_LOOP_LENGTH = 8; // Longest loop body (in instructions) checked for idling
 	const uint8_t VF = 0xF;
 	const uint8_t V0 = 0;
 };
 
-struct Experimental {
-	bool dotted_rendering_flag = false;
-	bool load_flag = false;
-	bool shift_flag = false;
-};
+// Every handler, in dispatch table order. Q marks the handlers templated on a quirk policy.
+#define CPU_OPCODES(X, Q) \
+	X(NULL) \
+	X(00E0) X(00EE) X(1nnn) X(2nnn) X(3xkk) X(4xkk) X(5xy0) X(6xkk) X(7xkk) \
+	X(8xy0) Q(8xy1) Q(8xy2) Q(8xy3) X(8xy4) X(8xy5) Q(8xy6) X(8xy7) Q(8xyE) X(9xy0) \
+	X(Annn) Q(Bnnn) X(Cxkk) Q(Dxyn) X(Ex9E) X(ExA1) X(Fx07) X(Fx0A) X(Fx15) X(Fx18) \
+	X(Fx1E) X(Fx29) X(Fx33) Q(Fx55) Q(Fx65) \
+	X(00Bn) X(00Cn) X(00FB) X(00FC) X(00FD) X(00FE) X(00FF) Q(Dxy0) X(Fx30) X(Fx75) X(Fx85) \
+	X(02A0) X(5xy1) X(Bxy0) X(Bxyn) X(ExF2) X(ExF5) X(FxFB) X(FxF8) \
+	X(5xy1_E) X(5xy2) X(5xy3) X(9xy1) X(9xy2) X(9xy3) X(Fx75_E) X(Fx94)
 
 class CPU {
+	friend class AOT;
+	friend class JIT;
+	friend class LaneCPU;
+	friend struct Recompiled;
 public:
+	// Events raised while running, RunCycles/RunFrame can stop on them
+	enum Event : uint8_t {
+		EVENT_NONE = 0,
+		EVENT_KEY_WAIT = 1 << 0, // Fx0A is waiting for a key
+		EVENT_EXIT = 1 << 1, // 00FD
+		EVENT_DRAW = 1 << 2, // The display changed
+		EVENT_FRAME = 1 << 3, // RunFrame finished a frame and ticked the timers
+		EVENT_LOOP = 1 << 4 // 1nnn jumped back over a short loop body (idle loop candidate)
+	};
+
+	// Snapshot of the machine, see SaveState. Plain data in host byte order, files hold it as is.
+	// The fields are ordered to leave no padding, so equal machines have equal bytes.
+	struct State {
+		static const uint32_t MAGIC = 0x53533843; // "C8SS"
+		static const uint16_t VERSION = 1;
+
+		uint32_t magic;
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t size; // sizeof(State), rejects files from builds with another layout
+		uint32_t frameCycles;
+		char variant[16]; // A state only loads into the variant that saved it
+		uint64_t video[cst::VIDEO_HEIGHT][cst::VIDEO_ROW_WORDS];
+		uint8_t memory[cst::MEMORY_SIZE];
+		uint16_t stack[cst::STACK_LEVELS];
+		uint16_t index;
+		uint16_t pc;
+		uint32_t random; // RNG state
+		uint8_t registers[cst::REGISTER_COUNT];
+		uint8_t userRegisters[cst::USER_RESISTER_COUNT];
+		uint8_t keypad[cst::KEY_COUNT];
+		uint8_t sp;
+		uint8_t delayTimer;
+		uint8_t soundTimer;
+		bool extendedMode;
+		bool quit;
+		bool loadFlag;
+		bool shiftFlag;
+		bool dottedRenderingFlag;
+	};
+
 	CPU();
+	static std::unique_ptr<CPU> Create(std::string const& variant);
 	void LoadROM(char const* filename);
+	void LoadROM(uint8_t const* data, size_t size);
+	void Seed(uint32_t seed);
 	void Cycle();
+	uint32_t RunCycles(uint32_t count, uint8_t stopOn = EVENT_NONE);
+	uint32_t RunFrame(uint32_t instructionsPerFrame, uint8_t stopOn = EVENT_NONE);
+	uint32_t RunFrameUntil(uint32_t instructionsPerFrame, uint32_t cycle, uint8_t stopOn = EVENT_NONE);
+	void TickTimers();
+	void SaveState(State& state) const;
+	bool CanLoadState(State const& state) const; // The state is from this version and variant
+	bool LoadState(State const& state); // Returns false if the state does not fit
+	static bool WriteState(State const& state, char const* fileName);
+	static bool ReadState(State& state, char const* fileName);
+	uint8_t lastEvents() const;
+	uint64_t skippedInstructions() const;
+	uint64_t unknownOpcodeCount() const;
 	bool isRomLoaded();
 	bool isSoundPlaying();
 	bool shouldClose();
+	char const* variantName() const;
+	QuirkSet quirks() const;
+	uint64_t const* display() const;
+	uint64_t TakeDirtyRows();
 
 	Experimental experimental{};
+	bool skipIdleLoops = true; // RunFrame fast-forwards idle loops and key waits to the end of the frame
+	bool reportUnknownOpcodes = true; // Print incorrect opcodes as they execute
+	bool switchDispatch = false; // RunCycles/RunFrame use the switch engine even where computed goto is available
+	bool tickTimersPerCycle = true; // Cycle (and the JIT/AOT blocks) tick the timers after every instruction, clear for 60 Hz timers
 	uint8_t keypad[cst::KEY_COUNT]{}; // 16 Input Keys
-	uint32_t *current_video;
+#if defined(CHIPEI_TRACE)
+	TraceWriter* trace{}; // Receives every interpreted instruction when set
+#endif
+#if defined(CHIPEI_PROFILE)
+	static std::vector<std::string> HandlerNames(); // Handler names of Profiler::Begin ("8xy4", "Dxyn", ...)
+	Profiler* profile{}; // Counts and times every interpreted instruction when set
+#endif
+protected:
+	typedef void (CPU::*Handler)();
+
+#define CPU_OPCODE_ID(name) ID_##name,
+	enum OpId : uint8_t { CPU_OPCODES(CPU_OPCODE_ID, CPU_OPCODE_ID) ID_COUNT };
+#undef CPU_OPCODE_ID
+
+	// Instantiation of the CPU for one quirk policy
+	struct Variant {
+		char const* name;
+		uint8_t const* ops; // OpId of every opcode
+		Handler handlers[ID_COUNT]; // Handler of each OpId
+		uint32_t (CPU::*run)(uint32_t count, uint8_t stopOn); // Threaded where the compiler allows it
+		uint32_t (CPU::*runSwitch)(uint32_t count, uint8_t stopOn);
+		QuirkSet (*quirks)(Experimental const& experimental);
+	};
+
+	explicit CPU(Variant const& variant);
+	template <class Quirks> static Variant const& VariantFor();
 private:
-	void ParseOpcodes();
+
+	// Pre-decoded instruction: resolved handler and operand fields
+	struct Instruction {
+		uint16_t opcode{};
+		uint16_t nnn{}; // 12-bit address
+		uint8_t x{}; // Register Vx
+		uint8_t y{}; // Register Vy
+		uint8_t n{}; // 4-bit nibble
+		uint8_t kk{}; // 8-bit byte
+		uint8_t op{}; // Handler OpId
+		bool valid = false;
+		bool watched = false; // Translated into native code
+		bool busy = false; // 1nnn closing a loop that is not idle
+	};
+
+	// Idle loop candidate waiting for its second pass
+	struct IdleLoop {
+		bool armed = false;
+		bool changed = false; // The state already changed once between passes
+		uint16_t target{}; // First address of the body
+		uint16_t jump{}; // Address of the closing 1nnn
+		uint32_t position{}; // Frame cycles at the first pass
+		uint16_t index{};
+		uint8_t registers[cst::REGISTER_COUNT]{};
+	};
+
+	static OpId Resolve(uint16_t opcode, Extension extension);
+	static uint8_t const* OpTable(Extension extension);
+	void Decode(Instruction& instruction, uint16_t opcode) const;
+	template <class Quirks> uint32_t RunVariant(uint32_t count, uint8_t stopOn);
+	template <class Quirks> uint32_t RunSwitch(uint32_t count, uint8_t stopOn);
+	static constexpr bool UsesPc(OpId op);
+	void Execute();
+	Instruction const& Fetch(uint16_t address);
+	void InvalidateCode(uint16_t address, uint16_t length);
+	static bool IsIdleOp(uint8_t op);
+	uint32_t SkipIdleLoop(uint32_t remaining, uint32_t& stepped);
+	bool DrawRow(unsigned int x, unsigned int y, uint64_t bits, bool clip);
+	uint8_t RandomByte();
 
 	void OP_NULL();
 
 	// Chip-8 Instructions
 	void OP_00E0();
 	void OP_00EE();
-	void OP_00FA();
 	void OP_1nnn();
 	void OP_2nnn();
 	void OP_3xkk();
@@ -56,19 +204,19 @@ private:
 	void OP_6xkk();
 	void OP_7xkk();
 	void OP_8xy0();
-	void OP_8xy1();
-	void OP_8xy2();
-	void OP_8xy3();
+	template <class Quirks> void OP_8xy1();
+	template <class Quirks> void OP_8xy2();
+	template <class Quirks> void OP_8xy3();
 	void OP_8xy4();
 	void OP_8xy5();
-	void OP_8xy6();
+	template <class Quirks> void OP_8xy6();
 	void OP_8xy7();
-	void OP_8xyE();
+	template <class Quirks> void OP_8xyE();
 	void OP_9xy0();
 	void OP_Annn();
-	void OP_Bnnn();
+	template <class Quirks> void OP_Bnnn();
 	void OP_Cxkk();
-	void OP_Dxyn();
+	template <class Quirks> void OP_Dxyn();
 	void OP_Ex9E();
 	void OP_ExA1();
 	void OP_Fx07();
@@ -78,11 +226,8 @@ private:
 	void OP_Fx1E();
 	void OP_Fx29();
 	void OP_Fx33();
-	void OP_Fx55();
-	void OP_Fx65();
-
-	// Chip-48
-	void OP_Bxnn(); // Replace OP_Bnnn
+	template <class Quirks> void OP_Fx55();
+	template <class Quirks> void OP_Fx65();
 
 	// Super Chip-8 Instructions
 	void OP_00Bn();
@@ -92,7 +237,7 @@ private:
 	void OP_00FD();
 	void OP_00FE();
 	void OP_00FF();
-	void OP_Dxy0();
+	template <class Quirks> void OP_Dxy0();
 	void OP_Fx30();
 	void OP_Fx75();
 	void OP_Fx85();
@@ -117,6 +262,7 @@ private:
 	void OP_Fx75_E();
 	void OP_Fx94();
 
+	Variant const* variant; // Decode Table and Handlers
 	uint8_t registers[cst::REGISTER_COUNT]{}; // 16 8-bit Registers
 	uint8_t userRegisters[cst::USER_RESISTER_COUNT]{}; // 8 8-bit HP-RPL User Flags
 	uint8_t memory[cst::MEMORY_SIZE]{}; // 4K Bytes of Memory
@@ -127,13 +273,34 @@ private:
 	uint8_t delayTimer{}; // 8-bit Delay Timer
 	uint8_t soundTimer{}; // 8-bit Sound Timer
 	uint16_t opcode; // Current Opcode
-	uint32_t video[cst::VIDEO_WIDTH * cst::VIDEO_HEIGHT]{}; // 64x32 Monochrome Display Memory (128x64 in Extended Mode)
+	Instruction const* inst{}; // Current Decoded Instruction
+	Instruction decodeCache[cst::MEMORY_SIZE / 2]{}; // Decoded Instructions at even addresses
+	Instruction scratch{}; // Decoded Instruction at an odd address
+	bool codeModified = false; // A store hit watched (translated) code
+	uint32_t storeCount = 0; // Stores to memory, LaneCPU checks whether lanes still share memory
+	uint16_t lastStore{}; // First address of the last store
+	uint16_t lastStoreLength{};
+	uint8_t events = EVENT_NONE; // Events raised since the last Cycle/RunCycles/RunFrame started
+	uint32_t frameCycles = 0; // Instructions executed in the current frame
+	IdleLoop idleLoop{}; // Idle loop detection state
+	uint64_t skipped = 0; // Instructions fast-forwarded by idle loop detection
+	uint64_t unknownOpcodes = 0; // Incorrect opcodes executed
+#if defined(CHIPEI_TRACE)
+	uint16_t traceAddress{}; // Address of the instruction being traced
+#endif
+	uint64_t dirtyRows = ~0ull; // Display rows changed since the last TakeDirtyRows, bit n for row n
+	uint64_t video[cst::VIDEO_HEIGHT][cst::VIDEO_ROW_WORDS]{}; // 128x64 1bpp Display, the leftmost pixel of a row is the top bit of its first word (64x32 pixels are drawn as 2x2 blocks)
 	
 	uint8_t background_color = 0;
 	bool extendedMode = false;
 	bool _isRomLoaded = false;
 	bool quit = false;
+	uint32_t random = 1; // Xorshift RNG state, never 0
+};
 
-	std::default_random_engine randGen;
-	std::uniform_int_distribution<unsigned short int> randByte;
+// CPU with the behaviour of one quirk policy (Chip8Quirks, SChipQuirks, ...) fixed at compile time
+template <class Quirks>
+class BasicCPU : public CPU {
+public:
+	BasicCPU() : CPU(VariantFor<Quirks>()) {}
 };
\ No newline at end of file
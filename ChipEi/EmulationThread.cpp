@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "EmulationThread.h"
+
+EmulationThread::EmulationThread(CPU& cpu, uint32_t instructionsPerFrame, AOT* aot, JIT* jit, Platform* sound, Rewind* rewind, Movie* movie)
+	: cpu(cpu), instructionsPerFrame(instructionsPerFrame), aot(aot), jit(jit), sound(sound), rewind(rewind), movie(movie), scheduler(cst::FRAMES_PER_SECOND) {}
+
+EmulationThread::~EmulationThread() {
+	Stop();
+}
+
+// Start running frames, the 60 Hz timers tick once per frame
+void EmulationThread::Start() {
+	cpu.tickTimersPerCycle = false;
+	thread = std::thread(&EmulationThread::Run, this);
+}
+
+// Stop after the current frame and wait for the thread
+void EmulationThread::Stop() {
+	stopping.store(true, std::memory_order_release);
+	if (thread.joinable())
+		thread.join();
+}
+
+// Queue a key event, applied during the frame after the one it happened in
+bool EmulationThread::PushKey(KeyEvent const& event) {
+	return keys.Push(event);
+}
+
+// Ask for a snapshot, taken between frames
+void EmulationThread::RequestSave() {
+	saveRequested.store(true, std::memory_order_release);
+}
+
+// Copy out the snapshot asked for by RequestSave once the emulation thread took it
+bool EmulationThread::TakeSavedState(CPU::State& state) {
+	if (!saveReady.load(std::memory_order_acquire))
+		return false;
+	state = saveSlot;
+	saveReady.store(false, std::memory_order_release);
+	return true;
+}
+
+// Hand a state over to be loaded between frames
+bool EmulationThread::RequestLoad(CPU::State const& state) {
+	if (loadPending.load(std::memory_order_acquire))
+		return false;
+	loadSlot = state;
+	loadPending.store(true, std::memory_order_release);
+	return true;
+}
+
+// Start or stop stepping backwards, one recorded frame per 60 Hz frame
+void EmulationThread::SetRewinding(bool rewinding) {
+	this->rewinding.store(rewinding, std::memory_order_release);
+}
+
+// Show the display N frames ahead of the real state
+void EmulationThread::SetRunAhead(uint32_t frames) {
+	runAhead = frames;
+}
+
+// Newest completed frame, nullptr if none was completed since the last call
+EmulationThread::Frame const* EmulationThread::LatestFrame() {
+	return frames.Latest();
+}
+
+// Check if the program exited (00FD)
+bool EmulationThread::hasExited() const {
+	return exited.load(std::memory_order_acquire);
+}
+
+// Frame pacing of the emulation thread and the host time run-ahead adds to each frame
+void EmulationThread::Report(std::ostream& out) const {
+	scheduler.Report(out);
+	if (!aheadCount)
+		return;
+	out << "run-ahead " << runAhead << " frames: " << aheadTime / aheadCount << " us per frame (longest " << aheadMax
+		<< " us), real frame " << frameTime / aheadCount << " us" << std::endl;
+}
+
+// Frames run (and stepped back) so far
+uint64_t EmulationThread::frameNumber() const {
+	return frameCount;
+}
+
+// Thread body: run a frame with its key events (or step back one), pass on its sound, record and publish it and wait for the next one
+void EmulationThread::Run() {
+	while (!stopping.load(std::memory_order_acquire)) {
+		ProcessStates();
+		if (rewind && rewinding.load(std::memory_order_acquire)) {
+			if (rewind->StepBack(1, frameState))
+				cpu.LoadState(frameState);
+			if (sound)
+				sound->ProcessSound(false);
+			Publish();
+			scheduler.Wait();
+			continue;
+		}
+
+		FrameScheduler::Clock::time_point start = FrameScheduler::Clock::now();
+		RunFrame();
+		if (runAhead)
+			frameTime += std::chrono::duration<double, std::micro>(FrameScheduler::Clock::now() - start).count();
+		if (sound)
+			sound->ProcessSound(cpu.isSoundPlaying());
+		if (rewind) {
+			cpu.SaveState(frameState);
+			rewind->Push(frameState);
+		}
+		if (runAhead)
+			RunAhead();
+		else
+			Publish();
+
+		if (cpu.shouldClose()) {
+			exited.store(true, std::memory_order_release);
+			return;
+		}
+		scheduler.Wait();
+	}
+}
+
+// Load and save the states requested since the last frame
+void EmulationThread::ProcessStates() {
+	if (loadPending.load(std::memory_order_acquire)) {
+		cpu.LoadState(loadSlot);
+		loadPending.store(false, std::memory_order_release);
+	}
+	if (saveRequested.load(std::memory_order_acquire) && !saveReady.load(std::memory_order_acquire)) {
+		saveRequested.store(false, std::memory_order_relaxed);
+		cpu.SaveState(saveSlot);
+		saveReady.store(true, std::memory_order_release);
+	}
+}
+
+// Hand the display over to the presenting thread
+void EmulationThread::Publish() {
+	Frame& frame = frames.back();
+	std::memcpy(frame.video, cpu.display(), sizeof(frame.video));
+	frame.number = ++frameCount;
+	frames.Publish();
+}
+
+// Run runAhead frames past the real state with the keypad as is, publish their display and restore the
+// real state. Costs runAhead more frames of emulation and a save/load, without allocating.
+void EmulationThread::RunAhead() {
+	FrameScheduler::Clock::time_point start = FrameScheduler::Clock::now();
+	cpu.SaveState(aheadState);
+	// The frames run ahead are thrown away, keep them out of the trace and the profile
+#if defined(CHIPEI_TRACE)
+	TraceWriter* trace = cpu.trace;
+	cpu.trace = nullptr;
+#endif
+#if defined(CHIPEI_PROFILE)
+	Profiler* profile = cpu.profile;
+	cpu.profile = nullptr;
+#endif
+	for (uint32_t frame = 0; frame < runAhead && !cpu.shouldClose(); ++frame) {
+		uint32_t executed = 0;
+		RunUntil(instructionsPerFrame, executed);
+	}
+#if defined(CHIPEI_TRACE)
+	cpu.trace = trace;
+#endif
+#if defined(CHIPEI_PROFILE)
+	cpu.profile = profile;
+#endif
+	Publish();
+	cpu.LoadState(aheadState);
+
+	double time = std::chrono::duration<double, std::micro>(FrameScheduler::Clock::now() - start).count();
+	aheadTime += time;
+	aheadMax = std::max(aheadMax, time);
+	++aheadCount;
+}
+
+// Run one frame of instructions and tick the timers. Key events of the frame interval before this one
+// are applied at their cycle, older ones at the start and newer ones wait for the next frame.
+void EmulationThread::RunFrame() {
+	int64_t const end = std::chrono::duration_cast<std::chrono::nanoseconds>(scheduler.frameStart().time_since_epoch()).count();
+	int64_t const length = std::chrono::duration_cast<std::chrono::nanoseconds>(scheduler.frameTime()).count();
+	int64_t const start = end - length;
+	uint32_t executed = 0;
+
+	while (hasNextKey || keys.Pop(nextKey)) {
+		hasNextKey = true;
+		if (nextKey.time >= end)
+			break;
+		int64_t offset = nextKey.time > start ? nextKey.time - start : 0;
+		RunUntil((uint32_t)(offset * instructionsPerFrame / length), executed);
+		cpu.keypad[nextKey.key & (cst::KEY_COUNT - 1)] = nextKey.pressed;
+		if (movie)
+			movie->Record((uint32_t)frameCount, executed, cpu.keypad);
+		hasNextKey = false;
+	}
+	RunUntil(instructionsPerFrame, executed);
+}
+
+// Run the frame up to cycle instructions, the timers tick when it completes
+void EmulationThread::RunUntil(uint32_t cycle, uint32_t& executed) {
+	if (executed >= cycle && cycle < instructionsPerFrame)
+		return;
+	if (!aot && !jit) {
+		executed += cpu.RunFrameUntil(instructionsPerFrame, cycle);
+		return;
+	}
+
+	while (executed < cycle && !cpu.shouldClose()) {
+		executed += aot ? aot->Step(cpu, cycle - executed) : jit->Step(cpu, cycle - executed);
+	}
+	if (cycle >= instructionsPerFrame)
+		cpu.TickTimers();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+#include "AOT.h"
+#include "CPU.h"
+#include "FrameScheduler.h"
+#include "JIT.h"
+#include "Movie.h"
+#include "Platform.h"
+#include "Rewind.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+// Runs a CPU on its own thread in 60 Hz frames. Completed frames are published through a triple buffer
+// and timestamped key events come in through an SPSC queue, so a slow present never stalls emulation.
+// Input is replayed one frame late: an event from the previous frame interval is applied at the
+// instruction whose share of the frame matches its share of the interval, so taps shorter than a
+// frame still reach the program.
+// With run-ahead, each frame is followed by N more with the same keypad; their display is shown and the
+// state restored, which hides N frames of the program's own input lag.
+// The CPU must not be touched by other threads between Start and Stop.
+class EmulationThread {
+public:
+	// Display of one completed frame
+	struct Frame {
+		uint64_t video[cst::VIDEO_HEIGHT][cst::VIDEO_ROW_WORDS];
+		uint64_t number; // Frames run so far
+	};
+
+	// aot or jit run the frames instead of the interpreter when given.
+	// sound gets the buzzer state after every frame, from the emulation thread.
+	// rewind records every frame when given, SetRewinding steps back through it.
+	// movie records the keypad at every change when given.
+	EmulationThread(CPU& cpu, uint32_t instructionsPerFrame, AOT* aot, JIT* jit, Platform* sound, Rewind* rewind, Movie* movie);
+	~EmulationThread();
+	EmulationThread(EmulationThread const&) = delete;
+	EmulationThread& operator=(EmulationThread const&) = delete;
+
+	void Start();
+	void Stop();
+	bool PushKey(KeyEvent const& event); // Events in time order, returns false if the queue is full, retry later
+	void RequestSave(); // Snapshot the CPU after the current frame
+	bool TakeSavedState(CPU::State& state); // Copy out a requested snapshot, false until it is ready
+	bool RequestLoad(CPU::State const& state); // Restore before the next frame, false while a load is pending
+	void SetRewinding(bool rewinding); // Step back one recorded frame per frame instead of running
+	void SetRunAhead(uint32_t frames); // Frames to run ahead for the display, call before Start
+	Frame const* LatestFrame(); // Newest completed frame, nullptr if none since the last call
+	bool hasExited() const; // The program ran 00FD
+	void Report(std::ostream& out) const; // Frame pacing statistics, call after Stop
+	uint64_t frameNumber() const; // Frames run, call after Stop
+private:
+	void Run();
+	void RunFrame();
+	void ProcessStates();
+	void Publish();
+	void RunAhead();
+	void RunUntil(uint32_t cycle, uint32_t& executed);
+
+	CPU& cpu;
+	uint32_t instructionsPerFrame;
+	AOT* aot;
+	JIT* jit;
+	Platform* sound;
+	Rewind* rewind;
+	Movie* movie;
+	FrameScheduler scheduler;
+	TripleBuffer<Frame> frames;
+	SpscQueue<KeyEvent, 256> keys;
+	KeyEvent nextKey{}; // Event popped ahead of its frame
+	bool hasNextKey = false;
+	std::atomic<bool> stopping{ false };
+	std::atomic<bool> exited{ false };
+	std::atomic<bool> saveRequested{ false };
+	std::atomic<bool> saveReady{ false }; // saveSlot holds a snapshot for TakeSavedState
+	std::atomic<bool> loadPending{ false }; // loadSlot holds a state for the emulation thread
+	std::atomic<bool> rewinding{ false };
+	CPU::State saveSlot;
+	CPU::State loadSlot;
+	CPU::State frameState; // Rewind record or step (emulation thread only)
+	CPU::State aheadState; // Real state while running ahead (emulation thread only)
+	uint32_t runAhead = 0;
+	uint64_t aheadCount = 0; // Frames that ran ahead
+	double frameTime = 0; // Host time of the real frames, in us
+	double aheadTime = 0; // Host time added by running ahead, in us
+	double aheadMax = 0;
+	uint64_t frameCount = 0;
+	std::thread thread;
+};
\ No newline at end of file
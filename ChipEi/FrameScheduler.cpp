@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+#include "FrameScheduler.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <time.h>
+#endif
+
+// Time left to spin after the OS sleep, covers its wake-up latency
+#if defined(_WIN32)
+static std::chrono::microseconds const SPIN_TIME(1000);
+#else
+static std::chrono::microseconds const SPIN_TIME(200);
+#endif
+
+// Frames behind the schedule before it restarts from now
+static int const MAX_LATE_FRAMES = 4;
+
+FrameScheduler::FrameScheduler(uint32_t framesPerSecond)
+	: frameDuration(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / framesPerSecond) {
+#if defined(_WIN32)
+	// High resolution timers need Windows 10 1803, older versions get a regular one
+	timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!timer)
+		timer = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+#endif
+	nextFrame = lastFrame = Clock::now();
+}
+
+FrameScheduler::~FrameScheduler() {
+#if defined(_WIN32)
+	if (timer)
+		CloseHandle(timer);
+#endif
+}
+
+// Block until the next frame deadline and record the achieved frame time
+void FrameScheduler::Wait() {
+	nextFrame += frameDuration;
+
+	Clock::time_point now = Clock::now();
+	if (now - nextFrame > frameDuration * MAX_LATE_FRAMES) {
+		nextFrame = now;
+		++resyncs;
+	} else if (now < nextFrame) {
+		if (nextFrame - now > SPIN_TIME)
+			Sleep(nextFrame - now - SPIN_TIME);
+		while ((now = Clock::now()) < nextFrame)
+			std::this_thread::yield();
+	}
+
+	double interval = std::chrono::duration<double, std::milli>(now - lastFrame).count();
+	double late = std::chrono::duration<double, std::milli>(now - nextFrame).count();
+	lastFrame = now;
+	++frames;
+	intervalSum += interval;
+	intervalSquares += interval * interval;
+	intervalMax = std::max(intervalMax, interval);
+	lateMax = std::max(lateMax, late);
+}
+
+// Scheduled start of the current frame, the construction time before the first Wait
+FrameScheduler::Clock::time_point FrameScheduler::frameStart() const {
+	return nextFrame;
+}
+
+// Length of a frame
+FrameScheduler::Clock::duration FrameScheduler::frameTime() const {
+	return frameDuration;
+}
+
+// Print the mean frame time, its standard deviation (jitter) and the worst cases
+void FrameScheduler::Report(std::ostream& out) const {
+	if (!frames)
+		return;
+	double mean = intervalSum / frames;
+	double jitter = std::sqrt(std::max(0.0, intervalSquares / frames - mean * mean));
+	double target = std::chrono::duration<double, std::milli>(frameDuration).count();
+	out << "frames " << frames << ", frame time " << mean << " ms (target " << target << " ms), jitter "
+		<< jitter << " ms, longest " << intervalMax << " ms, latest wake-up " << lateMax << " ms, resyncs "
+		<< resyncs << std::endl;
+}
+
+// Sleep with the OS timer, may overshoot by the timer resolution
+void FrameScheduler::Sleep(Clock::duration duration) {
+#if defined(_WIN32)
+	if (timer) {
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100); // Relative, 100 ns units
+		if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+			WaitForSingleObject(timer, INFINITE);
+			return;
+		}
+	}
+	std::this_thread::sleep_for(duration);
+#elif defined(TIMER_ABSTIME)
+	// Absolute deadline on the monotonic clock, so interrupted sleeps resume towards the same point
+	timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	deadline.tv_sec += (time_t)(nanoseconds / 1000000000);
+	deadline.tv_nsec += (long)(nanoseconds % 1000000000);
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_nsec -= 1000000000;
+		++deadline.tv_sec;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+#else
+	std::this_thread::sleep_for(duration);
+#endif
+}
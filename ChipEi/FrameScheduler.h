@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Paces a loop at a fixed frame rate. Each Wait sleeps with the OS timer until shortly before the next
+// frame deadline and spins the rest of the way. Deadlines follow a fixed schedule, so a late frame
+// shortens the next wait; after falling several frames behind the schedule restarts from now.
+class FrameScheduler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	explicit FrameScheduler(uint32_t framesPerSecond);
+	~FrameScheduler();
+	FrameScheduler(FrameScheduler const&) = delete;
+	FrameScheduler& operator=(FrameScheduler const&) = delete;
+
+	void Wait(); // Block until the next frame deadline
+	Clock::time_point frameStart() const; // Deadline the last Wait returned for
+	Clock::duration frameTime() const;
+	void Report(std::ostream& out) const; // Print the achieved frame times and jitter
+private:
+	void Sleep(Clock::duration duration);
+
+	Clock::duration frameDuration;
+	Clock::time_point nextFrame; // Deadline of the next frame
+	Clock::time_point lastFrame; // When the last Wait returned
+	uint64_t frames = 0; // Measured frame intervals
+	uint64_t resyncs = 0; // Times the schedule restarted
+	double intervalSum = 0; // Sum of the frame intervals, in ms
+	double intervalSquares = 0; // Sum of their squares
+	double intervalMax = 0;
+	double lateMax = 0; // Largest wake-up delay past a deadline, in ms
+#if defined(_WIN32)
+	void* timer{}; // High resolution waitable timer
+#endif
+};
\ No newline at end of file
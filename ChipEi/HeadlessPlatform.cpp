@@ -0,0 +1,87 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "CPU.h"
+#include "HeadlessPlatform.h"
+
+HeadlessPlatform::HeadlessPlatform(char const* scriptFileName, int textureWidth, int textureHeight, uint32_t frameLimit)
+	: width(textureWidth), height(textureHeight), frameLimit(frameLimit) {
+	if (!scriptFileName)
+		return;
+
+	_isScriptLoaded = script.Load(scriptFileName);
+}
+
+// Report the last frame
+HeadlessPlatform::~HeadlessPlatform() {
+	std::cout << std::dec << "frames " << frame << " hash " << std::hex << std::setw(16) << std::setfill('0')
+		<< lastHash << std::dec << std::setfill(' ') << std::endl;
+}
+
+// Present a frame: run the hash and dump commands of the frame. The hash is only recomputed when rows changed.
+void HeadlessPlatform::Update(uint64_t const* display, uint64_t dirtyRows) {
+	if (dirtyRows || frame == 0)
+		lastHash = Hash(display, width, height);
+
+	for (; nextOutput < script.commands.size() && script.commands[nextOutput].frame <= frame; ++nextOutput) {
+		InputScript::Command const& command = script.commands[nextOutput];
+		if (command.frame < frame)
+			continue;
+
+		if (command.action == InputScript::Action::Hash) {
+			std::cout << std::dec << "frame " << frame << " hash " << std::hex << std::setw(16) << std::setfill('0')
+				<< lastHash << std::dec << std::setfill(' ') << std::endl;
+		} else if (command.action == InputScript::Action::Dump) {
+			Dump(display, command.file);
+		}
+	}
+
+	++frame;
+	if (frameLimit && frame >= frameLimit)
+		quit = true;
+}
+
+// Apply the key and quit commands of the next frame
+bool HeadlessPlatform::ProcessInput(uint8_t* keys) {
+	quit |= script.Apply(frame, keys, nextInput);
+	return quit;
+}
+
+// No audio output
+void HeadlessPlatform::ProcessSound(bool /*play*/) {}
+
+// Check if the script parsed without errors
+bool HeadlessPlatform::isScriptLoaded() { return _isScriptLoaded; }
+
+// Frames presented so far
+uint32_t HeadlessPlatform::frameCount() { return frame; }
+
+// 64-bit FNV-1a hash of the packed frame, bytes taken most significant first
+uint64_t HeadlessPlatform::Hash(uint64_t const* frame, int width, int height) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < (size_t)(width + 63) / 64 * height; ++i) {
+		for (int shift = 56; shift >= 0; shift -= 8) {
+			hash ^= (uint8_t)(frame[i] >> shift);
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+// Write the frame as a binary PPM, lit pixels white
+void HeadlessPlatform::Dump(uint64_t const* frame, std::string const& fileName) {
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<uint32_t> pixels((size_t)width * height);
+	Expand(frame, pixels.data(), width, 0, height, 0xFFFFFF);
+	for (uint32_t pixel : pixels) {
+		char rgb[3] = { (char)(pixel >> 16), (char)(pixel >> 8), (char)pixel };
+		file.write(rgb, sizeof(rgb));
+	}
+}
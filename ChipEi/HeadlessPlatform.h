@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "InputScript.h"
+#include "Platform.h"
+
+// Platform without a display: keys come from an InputScript and frames are hashed or dumped on request
+class HeadlessPlatform : public Platform {
+public:
+	HeadlessPlatform(char const* scriptFileName, int textureWidth, int textureHeight, uint32_t frameLimit);
+	~HeadlessPlatform();
+	void Update(uint64_t const* display, uint64_t dirtyRows) override;
+	bool ProcessInput(uint8_t* keys) override;
+	void ProcessSound(bool play) override;
+
+	bool isScriptLoaded();
+	uint32_t frameCount();
+
+	static uint64_t Hash(uint64_t const* frame, int width, int height);
+private:
+	void Dump(uint64_t const* frame, std::string const& fileName);
+
+	InputScript script;
+	size_t nextInput = 0; // Next key/quit command
+	size_t nextOutput = 0; // Next hash/dump command
+	int width;
+	int height;
+	uint32_t frameLimit; // Stop after this many frames, 0 for no limit
+	uint32_t frame = 0; // Frames presented
+	uint64_t lastHash = 0;
+	bool quit = false;
+	bool _isScriptLoaded = true;
+};
\ No newline at end of file
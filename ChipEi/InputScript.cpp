@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "CPU.h"
+#include "InputScript.h"
+
+// Parse a script file, invalid lines are reported and skipped
+bool InputScript::Load(char const* fileName) {
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+
+	bool loaded = true;
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line)) {
+		++lineNumber;
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream words(line);
+		Command command{};
+		std::string action;
+		if (!(words >> command.frame))
+			continue;
+		words >> action;
+
+		bool valid = true;
+		if (action == "down" || action == "up") {
+			unsigned int key = cst::KEY_COUNT;
+			words >> std::hex >> key;
+			command.action = action == "down" ? Action::Down : Action::Up;
+			command.key = (uint8_t)key;
+			valid = key < cst::KEY_COUNT;
+		} else if (action == "hash") {
+			command.action = Action::Hash;
+		} else if (action == "dump") {
+			command.action = Action::Dump;
+			valid = (bool)(words >> command.file);
+		} else if (action == "quit") {
+			command.action = Action::Quit;
+		} else {
+			valid = false;
+		}
+
+		if (!valid) {
+			std::cout << fileName << ":" << lineNumber << ": Invalid command: " << line << std::endl;
+			loaded = false;
+			continue;
+		}
+		commands.push_back(command);
+	}
+
+	std::stable_sort(commands.begin(), commands.end(), [](Command const& a, Command const& b) { return a.frame < b.frame; });
+	return loaded;
+}
+
+// Apply the key and quit commands up to frame, starting at command next
+bool InputScript::Apply(uint32_t frame, uint8_t* keys, size_t& next) const {
+	bool quit = false;
+	for (; next < commands.size() && commands[next].frame <= frame; ++next) {
+		Command const& command = commands[next];
+		if (command.action == Action::Down) {
+			keys[command.key] = 1;
+		} else if (command.action == Action::Up) {
+			keys[command.key] = 0;
+		} else if (command.action == Action::Quit) {
+			quit = true;
+		}
+	}
+	return quit;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timed commands driving a run without a user, loaded from a text file.
+//
+// Lines are "<frame> <command> [argument]", frames counted from 0, '#' starts a comment:
+//   <frame> down <key>    Press hex key 0-F
+//   <frame> up <key>      Release hex key 0-F
+//   <frame> hash          Print the hash of the frame
+//   <frame> dump <file>   Write the frame as a binary PPM image
+//   <frame> quit          Stop before the frame runs
+class InputScript {
+public:
+	enum class Action { Down, Up, Hash, Dump, Quit };
+
+	struct Command {
+		uint32_t frame;
+		Action action;
+		uint8_t key;
+		std::string file;
+	};
+
+	bool Load(char const* fileName); // Returns false if the file is missing or has invalid lines
+	bool Apply(uint32_t frame, uint8_t* keys, size_t& next) const; // Key and quit commands up to frame, returns true to quit
+
+	std::vector<Command> commands; // Sorted by frame
+};
\ No newline at end of file
@@ -0,0 +1,680 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "JIT.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIPEI_JIT_X64
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+const size_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+const unsigned int MAX_BLOCK_LENGTH = 64;
+const unsigned int MIN_BLOCK_LENGTH = 4; // Shorter blocks cost more to enter and leave than they save, unless they jump
+
+#ifdef CHIPEI_JIT_X64
+// x86-64 registers
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Callee-saved registers pushed by every block (covers both the SysV and Win64 ABI)
+const Reg SAVED_REGS[] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+
+// Host registers that hold V registers inside a block, I lives in R14 and RBX points at the CPU
+const Reg V_POOL[] = { RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R15 };
+const unsigned int V_POOL_SIZE = sizeof(V_POOL) / sizeof(V_POOL[0]);
+const Reg INDEX_REG = R14;
+
+// ALU opcodes (op r/m32, r32) and their /digit forms (op r/m32, imm32)
+const uint8_t ALU_MOV = 0x89, ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31, ALU_CMP = 0x39;
+const uint8_t EXT_ADD = 0, EXT_AND = 4, EXT_SUB = 5, EXT_CMP = 7, EXT_SHL = 4, EXT_SHR = 5;
+
+// Minimal x86-64 machine code emitter
+struct Emitter {
+	std::vector<uint8_t> bytes;
+
+	void Byte(uint8_t b) { bytes.push_back(b); }
+	void Dword(uint32_t d) { for (int i = 0; i < 4; ++i) Byte((d >> (8 * i)) & 0xFFu); }
+
+	void Rex(bool w, int reg, int rm, bool force = false) {
+		uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+		if (rex != 0x40 || force)
+			Byte(rex);
+	}
+	void ModRR(int reg, int rm) { Byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+	// [rbx + disp32]
+	void ModMem(int reg, int32_t disp) { Byte(0x80 | ((reg & 7) << 3) | RBX); Dword(disp); }
+
+	void Push(Reg r) { Rex(false, 0, r); Byte(0x50 + (r & 7)); }
+	void Pop(Reg r) { Rex(false, 0, r); Byte(0x58 + (r & 7)); }
+	void MovRR64(Reg dst, Reg src) { Rex(true, src, dst); Byte(0x89); ModRR(src, dst); }
+
+	void AluRR(uint8_t op, Reg dst, Reg src) { Rex(false, src, dst); Byte(op); ModRR(src, dst); }
+	void AluRI(uint8_t ext, Reg dst, uint32_t imm) { Rex(false, 0, dst); Byte(0x81); ModRR(ext, dst); Dword(imm); }
+	void MovRI(Reg dst, uint32_t imm) { Rex(false, 0, dst); Byte(0xB8 + (dst & 7)); Dword(imm); }
+	void ShiftRI(uint8_t ext, Reg dst, uint8_t imm) { Rex(false, 0, dst); Byte(0xC1); ModRR(ext, dst); Byte(imm); }
+	void ImulRRI(Reg dst, Reg src, uint32_t imm) { Rex(false, dst, src); Byte(0x69); ModRR(dst, src); Dword(imm); }
+	void SetaAl() { Byte(0x0F); Byte(0x97); Byte(0xC0); }
+
+	void LoadByte(Reg dst, int32_t disp) { Rex(false, dst, RBX); Byte(0x0F); Byte(0xB6); ModMem(dst, disp); }
+	void LoadWord(Reg dst, int32_t disp) { Rex(false, dst, RBX); Byte(0x0F); Byte(0xB7); ModMem(dst, disp); }
+	void StoreByte(Reg src, int32_t disp) { Rex(false, src, RBX, true); Byte(0x88); ModMem(src, disp); }
+	void StoreWord(Reg src, int32_t disp) { Byte(0x66); Rex(false, src, RBX); Byte(0x89); ModMem(src, disp); }
+	void StoreWordImm(int32_t disp, uint16_t imm) { Byte(0x66); Byte(0xC7); ModMem(0, disp); Byte(imm & 0xFFu); Byte(imm >> 8); }
+
+	// jne/je rel8, returns the offset to patch
+	size_t Jne() { Byte(0x75); Byte(0); return bytes.size() - 1; }
+	size_t Je() { Byte(0x74); Byte(0); return bytes.size() - 1; }
+	void Patch(size_t at) { bytes[at] = (uint8_t)(bytes.size() - at - 1); }
+	// jb/jmp rel32, returns the offset of the rel32, aimed with SetJump once the code is in place
+	size_t Jb() { Byte(0x0F); Byte(0x82); Dword(0); return bytes.size() - 4; }
+	size_t Jmp() { Byte(0xE9); Dword(0); return bytes.size() - 4; }
+	void Ret() { Byte(0xC3); }
+};
+#endif
+
+// Aim the rel32 of a jump at target
+static void SetJump(uint8_t* rel32, uint8_t const* target) {
+	int32_t const displacement = (int32_t)(target - (rel32 + 4));
+	std::memcpy(rel32, &displacement, sizeof(displacement));
+}
+
+JIT::JIT() {
+#ifdef CHIPEI_JIT_X64
+#if defined(_WIN32)
+	code = (uint8_t*)VirtualAlloc(nullptr, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	code = buffer == MAP_FAILED ? nullptr : (uint8_t*)buffer;
+#endif
+	if (code)
+		codeSize = CODE_BUFFER_SIZE;
+	else
+		std::cout << "JIT: Failed to allocate executable memory, interpreting." << std::endl;
+#endif
+	Flush();
+}
+
+JIT::~JIT() {
+#ifdef CHIPEI_JIT_X64
+	if (!code)
+		return;
+#if defined(_WIN32)
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, codeSize);
+#endif
+#endif
+}
+
+// Check if the host can run translated code
+bool JIT::isSupported() {
+#ifdef CHIPEI_JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Run exactly a frame of instructions like CPU::RunFrame, then tick the timers once. Chains stop where the
+// frame ends and a block that would cross it is interpreted instead. The quirks only change between frames
+// (settings, LoadState), so they are checked once. Returns instructions executed.
+uint32_t JIT::RunFrame(CPU& cpu, uint32_t instructionsPerFrame) {
+	SyncQuirks(cpu);
+
+	uint32_t executed = 0;
+	while (executed < instructionsPerFrame)
+		executed += Run(cpu, instructionsPerFrame - executed);
+	cpu.TickTimers();
+	return executed;
+}
+
+// Drop every translated block and put the exit stub back at the start of the buffer
+void JIT::Flush() {
+	for (Block& block : blocks) {
+		block = Block{};
+	}
+	codeUsed = 0;
+
+#ifdef CHIPEI_JIT_X64
+	if (!code)
+		return;
+
+	// Blocks leave through here: return the budget left and restore the host registers
+	Emitter e;
+	e.AluRR(ALU_MOV, RAX, RDX);
+	for (int i = sizeof(SAVED_REGS) / sizeof(SAVED_REGS[0]) - 1; i >= 0; --i) {
+		e.Pop(SAVED_REGS[i]);
+	}
+	e.Ret();
+	std::copy(e.bytes.begin(), e.bytes.end(), code);
+	codeUsed = e.bytes.size();
+#endif
+}
+
+// Step: Check the quirks, then run from PC for at most limit instructions
+uint32_t JIT::Step(CPU& cpu, uint32_t limit) {
+	SyncQuirks(cpu);
+	return Run(cpu, limit);
+}
+
+// Blocks bake in the quirks, retranslate when they change
+void JIT::SyncQuirks(CPU const& cpu) {
+	QuirkSet const current = cpu.quirks();
+	if (current != quirks) {
+		Flush();
+		quirks = current;
+	}
+}
+
+// Run the block at PC and the blocks it chains into for at most limit instructions. Without a block, or if
+// it is longer than limit, interpret: the whole untranslatable stretch in one batch when the timers tick per
+// frame, else a single instruction. Returns instructions executed.
+uint32_t JIT::Run(CPU& cpu, uint32_t limit) {
+	if (!code) {
+		cpu.Cycle();
+		return 1;
+	}
+
+	if (cpu.codeModified)
+		Invalidate(cpu);
+
+	uint16_t pc = cpu.pc;
+	if ((pc & 1u) || pc > cst::MEMORY_SIZE - 2) {
+		cpu.Cycle();
+		return 1;
+	}
+
+	Block& block = blocks[pc >> 1];
+	if (!block.compiled)
+		Compile(cpu, pc);
+
+	uint32_t executed = 1;
+	if (!block.fn || block.count > limit) {
+		// A store here may hit translated code
+		if (cpu.tickTimersPerCycle) {
+			cpu.Cycle();
+		} else {
+			executed = cpu.RunCycles(block.fn ? 1 : std::min<uint32_t>(block.count, limit));
+		}
+		if (cpu.codeModified)
+			Invalidate(cpu);
+		return executed;
+	}
+
+	executed = limit - block.fn(&cpu, limit);
+
+	// Blocks never read the timers, so tick them for the whole chain at once
+	if (cpu.tickTimersPerCycle) {
+		cpu.delayTimer = cpu.delayTimer > executed ? cpu.delayTimer - executed : 0;
+		cpu.soundTimer = cpu.soundTimer > executed ? cpu.soundTimer - executed : 0;
+	}
+	return executed;
+}
+
+// Drop blocks whose code bytes were overwritten since they were translated
+void JIT::Invalidate(CPU& cpu) {
+	bool dropped = false;
+	for (Block& block : blocks) {
+		if (!block.compiled)
+			continue;
+
+		for (uint16_t address = block.start; address < block.end; address += 2) {
+			if (!cpu.decodeCache[address >> 1].valid) {
+				block = Block{};
+				dropped = true;
+				break;
+			}
+		}
+	}
+	cpu.codeModified = false;
+
+	// Chains must not run into the dropped code
+	if (dropped)
+		Link();
+}
+
+// Aim the exits of every block at the chained entry of their successor, or at the exit stub if it has none
+void JIT::Link() {
+	for (Block& block : blocks) {
+		if (!block.fn)
+			continue;
+
+		for (unsigned int i = 0; i < block.exitCount; ++i) {
+			uint16_t const target = block.exits[i];
+			bool const inRange = !(target & 1u) && target <= cst::MEMORY_SIZE - 2;
+			uint8_t const* entry = inRange && blocks[target >> 1].entry ? blocks[target >> 1].entry : code;
+			SetJump(code + block.links[i], entry);
+		}
+	}
+}
+
+// Check if a block at address would reach MIN_BLOCK_LENGTH instructions or a jump, which can chain
+bool JIT::Worthwhile(CPU& cpu, uint16_t address) {
+	for (unsigned int length = 1; address <= cst::MEMORY_SIZE - 2; ++length, address += 2) {
+		uint8_t const op = cpu.Fetch(address).op;
+		if (!Translatable(op))
+			return false;
+		if (op == CPU::ID_1nnn || length == MIN_BLOCK_LENGTH)
+			return true;
+		if (op == CPU::ID_3xkk || op == CPU::ID_4xkk || op == CPU::ID_5xy0 || op == CPU::ID_9xy0)
+			return false;
+	}
+	return false;
+}
+
+// Instructions the blocks translate
+bool JIT::Translatable(uint8_t op) {
+	switch (op) {
+		case CPU::ID_1nnn: case CPU::ID_3xkk: case CPU::ID_4xkk: case CPU::ID_5xy0: case CPU::ID_6xkk: case CPU::ID_7xkk:
+		case CPU::ID_8xy0: case CPU::ID_8xy1: case CPU::ID_8xy2: case CPU::ID_8xy3: case CPU::ID_8xy4: case CPU::ID_8xy5:
+		case CPU::ID_8xy6: case CPU::ID_8xy7: case CPU::ID_8xyE: case CPU::ID_9xy0: case CPU::ID_Annn: case CPU::ID_Fx1E:
+		case CPU::ID_Fx29: case CPU::ID_Fx30:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Translate the block starting at address
+void JIT::Compile(CPU& cpu, uint16_t address) {
+	Block& block = blocks[address >> 1];
+	block = Block{};
+	block.compiled = true;
+	block.start = address;
+	block.end = address + 2;
+
+#ifdef CHIPEI_JIT_X64
+	// Collect the instructions of the block
+	std::vector<CPU::Instruction> instructions;
+	int vmap[cst::REGISTER_COUNT];
+	for (int& reg : vmap) {
+		reg = -1;
+	}
+	unsigned int allocated = 0;
+
+	bool const worthwhile = Worthwhile(cpu, address);
+	while (worthwhile && instructions.size() < MAX_BLOCK_LENGTH && address <= cst::MEMORY_SIZE - 2) {
+		CPU::Instruction instruction = cpu.Fetch(address);
+
+		bool terminator = false;
+		bool translatable = true;
+		uint8_t const vc = quirks.shiftUsesVy ? instruction.y : instruction.x;
+		uint8_t needed[3]{};
+		unsigned int neededCount = 0;
+
+		switch (instruction.op) {
+			case CPU::ID_6xkk: case CPU::ID_7xkk: case CPU::ID_Fx1E: case CPU::ID_Fx29: case CPU::ID_Fx30:
+				needed[neededCount++] = instruction.x;
+				break;
+			case CPU::ID_3xkk: case CPU::ID_4xkk:
+				needed[neededCount++] = instruction.x;
+				terminator = true;
+				break;
+			case CPU::ID_5xy0: case CPU::ID_9xy0:
+				needed[neededCount++] = instruction.x;
+				needed[neededCount++] = instruction.y;
+				terminator = true;
+				break;
+			case CPU::ID_8xy0:
+				needed[neededCount++] = instruction.x;
+				needed[neededCount++] = instruction.y;
+				break;
+			case CPU::ID_8xy1: case CPU::ID_8xy2: case CPU::ID_8xy3:
+				needed[neededCount++] = instruction.x;
+				needed[neededCount++] = instruction.y;
+				if (quirks.logicResetsVF)
+					needed[neededCount++] = cst::VF;
+				break;
+			case CPU::ID_8xy4: case CPU::ID_8xy5: case CPU::ID_8xy7:
+				needed[neededCount++] = instruction.x;
+				needed[neededCount++] = instruction.y;
+				needed[neededCount++] = cst::VF;
+				break;
+			case CPU::ID_8xy6: case CPU::ID_8xyE:
+				needed[neededCount++] = instruction.x;
+				needed[neededCount++] = vc;
+				needed[neededCount++] = cst::VF;
+				break;
+			case CPU::ID_Annn:
+				break;
+			case CPU::ID_1nnn:
+				terminator = true;
+				break;
+			default:
+				// Calls, returns, Bnnn, timers, draws, key waits, stores, ...
+				translatable = false;
+				break;
+		}
+		if (!translatable)
+			break;
+
+		// Stop before running out of host registers
+		unsigned int fresh = 0;
+		for (unsigned int i = 0; i < neededCount; ++i) {
+			bool seen = vmap[needed[i]] >= 0;
+			for (unsigned int j = 0; j < i; ++j) {
+				seen |= needed[j] == needed[i];
+			}
+			fresh += !seen;
+		}
+		if (allocated + fresh > V_POOL_SIZE)
+			break;
+
+		for (unsigned int i = 0; i < neededCount; ++i) {
+			if (vmap[needed[i]] < 0)
+				vmap[needed[i]] = allocated++;
+		}
+
+		instructions.push_back(instruction);
+		address += 2;
+		if (terminator)
+			break;
+	}
+
+	// Watch the covered code so stores into it drop the block
+	block.end = instructions.empty() ? block.start + 2 : address;
+	for (uint16_t watched = block.start; watched < block.end; watched += 2) {
+		cpu.decodeCache[watched >> 1].watched = true;
+	}
+
+	if (instructions.empty()) {
+		// Count the instructions up to the next block worth translating, the interpreter runs them in one batch
+		block.count = 1;
+		for (uint16_t next = block.start + 2; block.count < MAX_BLOCK_LENGTH && next <= cst::MEMORY_SIZE - 2; next += 2) {
+			if (Worthwhile(cpu, next))
+				break;
+			++block.count;
+		}
+		return;
+	}
+
+	// Field offsets inside the CPU object
+	uint8_t* base = (uint8_t*)&cpu;
+	int32_t const registersOffset = (int32_t)((uint8_t*)cpu.registers - base);
+	int32_t const indexOffset = (int32_t)((uint8_t*)&cpu.index - base);
+	int32_t const pcOffset = (int32_t)((uint8_t*)&cpu.pc - base);
+	int32_t const opcodeOffset = (int32_t)((uint8_t*)&cpu.opcode - base);
+	uint32_t const count = (uint32_t)instructions.size();
+
+	auto V = [&](uint8_t reg) { return V_POOL[vmap[reg]]; };
+	bool written[cst::REGISTER_COUNT]{};
+	bool indexUsed = false;
+	bool indexWritten = false;
+
+	Emitter e;
+
+	// Prologue: save callee-saved registers, point RBX at the CPU and keep the budget in EDX
+	for (Reg reg : SAVED_REGS) {
+		e.Push(reg);
+	}
+#if defined(_WIN32)
+	e.MovRR64(RBX, RCX);
+#else
+	e.MovRR64(RBX, RDI);
+	e.AluRR(ALU_MOV, RDX, RSI);
+#endif
+
+	// Chained entry: leave through the exit stub if the budget does not cover the block, then load the hot state
+	size_t const entry = e.bytes.size();
+	e.AluRI(EXT_CMP, RDX, count);
+	size_t const bail = e.Jb();
+	e.AluRI(EXT_SUB, RDX, count);
+	for (uint8_t reg = 0; reg < cst::REGISTER_COUNT; ++reg) {
+		if (vmap[reg] >= 0)
+			e.LoadByte(V(reg), registersOffset + reg);
+	}
+	for (CPU::Instruction const& instruction : instructions) {
+		indexUsed |= instruction.op == CPU::ID_Annn || instruction.op == CPU::ID_Fx1E
+			|| instruction.op == CPU::ID_Fx29 || instruction.op == CPU::ID_Fx30;
+	}
+	if (indexUsed)
+		e.LoadWord(INDEX_REG, indexOffset);
+
+	// Body: each instruction mirrors its OP_* handler step by step
+	uint16_t pc = block.start;
+	for (CPU::Instruction const& instruction : instructions) {
+		uint8_t const x = instruction.x;
+		uint8_t const y = instruction.y;
+		uint8_t const vc = quirks.shiftUsesVy ? y : x;
+		pc += 2;
+
+		switch (instruction.op) {
+			case CPU::ID_6xkk:
+				e.MovRI(V(x), instruction.kk);
+				written[x] = true;
+				break;
+			case CPU::ID_7xkk:
+				e.AluRI(EXT_ADD, V(x), instruction.kk);
+				e.AluRI(EXT_AND, V(x), 0xFF);
+				written[x] = true;
+				break;
+			case CPU::ID_8xy0:
+				e.AluRR(ALU_MOV, V(x), V(y));
+				written[x] = true;
+				break;
+			case CPU::ID_8xy1:
+				e.AluRR(ALU_OR, V(x), V(y));
+				written[x] = true;
+				if (quirks.logicResetsVF) {
+					e.MovRI(V(cst::VF), 0);
+					written[cst::VF] = true;
+				}
+				break;
+			case CPU::ID_8xy2:
+				e.AluRR(ALU_AND, V(x), V(y));
+				written[x] = true;
+				if (quirks.logicResetsVF) {
+					e.MovRI(V(cst::VF), 0);
+					written[cst::VF] = true;
+				}
+				break;
+			case CPU::ID_8xy3:
+				e.AluRR(ALU_XOR, V(x), V(y));
+				written[x] = true;
+				if (quirks.logicResetsVF) {
+					e.MovRI(V(cst::VF), 0);
+					written[cst::VF] = true;
+				}
+				break;
+			case CPU::ID_8xy4:
+				// The 32-bit sum of two bytes holds the carry in bit 8
+				e.AluRR(ALU_MOV, RAX, V(x));
+				e.AluRR(ALU_ADD, RAX, V(y));
+				e.AluRR(ALU_MOV, RCX, RAX);
+				e.ShiftRI(EXT_SHR, RCX, 8);
+				e.AluRR(ALU_MOV, V(cst::VF), RCX);
+				e.AluRI(EXT_AND, RAX, 0xFF);
+				e.AluRR(ALU_MOV, V(x), RAX);
+				written[x] = written[cst::VF] = true;
+				break;
+			case CPU::ID_8xy5:
+				e.AluRR(ALU_XOR, RAX, RAX);
+				e.AluRR(ALU_CMP, V(x), V(y));
+				e.SetaAl();
+				e.AluRR(ALU_MOV, V(cst::VF), RAX);
+				e.AluRR(ALU_MOV, RCX, V(x));
+				e.AluRR(ALU_SUB, RCX, V(y));
+				e.AluRI(EXT_AND, RCX, 0xFF);
+				e.AluRR(ALU_MOV, V(x), RCX);
+				written[x] = written[cst::VF] = true;
+				break;
+			case CPU::ID_8xy6:
+				e.AluRR(ALU_MOV, RAX, V(vc));
+				e.AluRI(EXT_AND, RAX, 1);
+				e.AluRR(ALU_MOV, V(cst::VF), RAX);
+				e.AluRR(ALU_MOV, RCX, V(vc));
+				e.ShiftRI(EXT_SHR, RCX, 1);
+				e.AluRR(ALU_MOV, V(x), RCX);
+				written[x] = written[cst::VF] = true;
+				break;
+			case CPU::ID_8xy7:
+				e.AluRR(ALU_XOR, RAX, RAX);
+				e.AluRR(ALU_CMP, V(y), V(x));
+				e.SetaAl();
+				e.AluRR(ALU_MOV, V(cst::VF), RAX);
+				e.AluRR(ALU_MOV, RCX, V(y));
+				e.AluRR(ALU_SUB, RCX, V(x));
+				e.AluRI(EXT_AND, RCX, 0xFF);
+				e.AluRR(ALU_MOV, V(x), RCX);
+				written[x] = written[cst::VF] = true;
+				break;
+			case CPU::ID_8xyE:
+				e.AluRR(ALU_MOV, RAX, V(vc));
+				e.ShiftRI(EXT_SHR, RAX, 7);
+				e.AluRR(ALU_MOV, V(cst::VF), RAX);
+				e.AluRR(ALU_MOV, RCX, V(vc));
+				e.ShiftRI(EXT_SHL, RCX, 1);
+				e.AluRI(EXT_AND, RCX, 0xFF);
+				e.AluRR(ALU_MOV, V(x), RCX);
+				written[x] = written[cst::VF] = true;
+				break;
+			case CPU::ID_Annn:
+				e.MovRI(INDEX_REG, instruction.nnn);
+				indexWritten = true;
+				break;
+			case CPU::ID_Fx1E:
+				e.AluRR(ALU_ADD, INDEX_REG, V(x));
+				e.AluRI(EXT_AND, INDEX_REG, 0xFFFF);
+				indexWritten = true;
+				break;
+			case CPU::ID_Fx29:
+			case CPU::ID_Fx30:
+				e.ImulRRI(INDEX_REG, V(x), instruction.op == CPU::ID_Fx29 ? 5 : 10);
+				e.AluRI(EXT_ADD, INDEX_REG, cst::FONTSET_START_ADDRESS);
+				indexWritten = true;
+				break;
+			default:
+				// 1nnn and the skips end the block below
+				break;
+		}
+	}
+
+	// Epilogue: write back the hot state, then store PC and jump to the successor (linked later)
+	for (uint8_t reg = 0; reg < cst::REGISTER_COUNT; ++reg) {
+		if (written[reg])
+			e.StoreByte(V(reg), registersOffset + reg);
+	}
+	if (indexWritten)
+		e.StoreWord(INDEX_REG, indexOffset);
+	e.StoreWordImm(opcodeOffset, instructions.back().opcode);
+
+	size_t links[2]{};
+	auto Exit = [&](uint16_t target) {
+		e.StoreWordImm(pcOffset, target);
+		block.exits[block.exitCount] = target;
+		links[block.exitCount++] = e.Jmp();
+	};
+	CPU::Instruction const& last = instructions.back();
+	switch (last.op) {
+		case CPU::ID_1nnn:
+			Exit(last.nnn);
+			break;
+		case CPU::ID_3xkk:
+		case CPU::ID_4xkk:
+		case CPU::ID_5xy0:
+		case CPU::ID_9xy0: {
+			// PC = next + 2 when the skip condition holds, else next
+			bool skipIfEqual = last.op == CPU::ID_3xkk || last.op == CPU::ID_5xy0;
+			if (last.op == CPU::ID_3xkk || last.op == CPU::ID_4xkk) {
+				e.AluRI(EXT_CMP, V(last.x), last.kk);
+			} else {
+				e.AluRR(ALU_CMP, V(last.x), V(last.y));
+			}
+			size_t patch = skipIfEqual ? e.Jne() : e.Je();
+			Exit(pc + 2);
+			e.Patch(patch);
+			Exit(pc);
+			break;
+		}
+		default:
+			Exit(pc);
+			break;
+	}
+
+	// Copy into the executable buffer, starting over when it is full
+	size_t start = (codeUsed + 15) & ~(size_t)15;
+	if (start + e.bytes.size() > codeSize) {
+		Block kept = block;
+		Flush();
+		block = kept;
+		start = (codeUsed + 15) & ~(size_t)15;
+	}
+	std::copy(e.bytes.begin(), e.bytes.end(), code + start);
+	codeUsed = start + e.bytes.size();
+	SetJump(code + start + bail, code);
+
+	block.fn = (BlockFn)(code + start);
+	block.entry = code + start + entry;
+	block.count = (uint16_t)count;
+	for (unsigned int i = 0; i < block.exitCount; ++i) {
+		block.links[i] = (uint32_t)(start + links[i]);
+	}
+	Link();
+#endif
+}
+
+// Run each ROM through the JIT and through CPU::Cycle side by side and compare the state after every Step,
+// which chains blocks for at most MAX_BLOCK_LENGTH instructions
+int JIT::Lockstep(char const* const* romFileNames, int romCount, uint32_t instructions, char const* variantName) {
+	int result = EXIT_SUCCESS;
+
+	for (int rom = 0; rom < romCount; ++rom) {
+		std::unique_ptr<CPU> referenceCpu = CPU::Create(variantName);
+		std::unique_ptr<CPU> translatedCpu = CPU::Create(variantName);
+		if (!referenceCpu) {
+			std::cout << "Unknown variant: " << variantName << std::endl;
+			return EXIT_FAILURE;
+		}
+		CPU& reference = *referenceCpu;
+		CPU& translated = *translatedCpu;
+		reference.LoadROM(romFileNames[rom]);
+		translated.LoadROM(romFileNames[rom]);
+		if (!reference.isRomLoaded()) {
+			result = EXIT_FAILURE;
+			continue;
+		}
+		reference.Seed(1);
+		translated.Seed(1);
+		reference.reportUnknownOpcodes = false;
+		translated.reportUnknownOpcodes = false;
+
+		JIT jit;
+		uint32_t executed = 0;
+		bool same = true;
+		while (executed < instructions && same) {
+			uint32_t count = jit.Step(translated, MAX_BLOCK_LENGTH);
+			for (uint32_t i = 0; i < count; ++i) {
+				reference.Cycle();
+			}
+			executed += count;
+			same = SameState(reference, translated);
+		}
+
+		if (same) {
+			std::cout << romFileNames[rom] << ": OK, " << std::dec << executed << " instructions, "
+				<< reference.unknownOpcodeCount() << " unknown opcodes" << std::endl;
+		} else {
+			std::cout << romFileNames[rom] << ": MISMATCH after " << std::dec << executed << " instructions at PC "
+				<< std::hex << reference.pc << std::dec << ", " << reference.unknownOpcodeCount() << " unknown opcodes" << std::endl;
+			result = EXIT_FAILURE;
+		}
+	}
+	return result;
+}
+
+// Compare the architectural state of two CPUs
+bool JIT::SameState(CPU const& a, CPU const& b) {
+	return std::memcmp(a.registers, b.registers, sizeof(a.registers)) == 0
+		&& std::memcmp(a.memory, b.memory, sizeof(a.memory)) == 0
+		&& std::memcmp(a.stack, b.stack, sizeof(a.stack)) == 0
+		&& std::memcmp(a.video, b.video, sizeof(a.video)) == 0
+		&& a.index == b.index && a.pc == b.pc && a.sp == b.sp
+		&& a.delayTimer == b.delayTimer && a.soundTimer == b.soundTimer
+		&& a.extendedMode == b.extendedMode;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "CPU.h"
+
+// x86-64 dynamic recompiler for straight-line CHIP-8 blocks.
+// Blocks hold V registers and I in host registers and end at 1nnn or a skip, then jump straight into
+// the next translated block while the instruction budget lasts. Every other instruction (draw, key wait,
+// stores, calls, ...) runs through the interpreter.
+class JIT {
+public:
+	JIT();
+	~JIT();
+	static bool isSupported();
+
+	uint32_t Step(CPU& cpu, uint32_t limit); // Run chained blocks for at most limit instructions or interpret a stretch, returns instructions executed
+	uint32_t RunFrame(CPU& cpu, uint32_t instructionsPerFrame); // Exactly a frame of instructions, then the timers (clear tickTimersPerCycle)
+	void Flush();
+
+	static int Lockstep(char const* const* romFileNames, int romCount, uint32_t instructions, char const* variantName);
+private:
+	typedef uint32_t (*BlockFn)(CPU* cpu, uint32_t budget); // Returns the budget left
+
+	struct Block {
+		BlockFn fn{}; // nullptr if the block could not be translated
+		uint8_t* entry{}; // Where chained blocks jump in, past the prologue
+		uint16_t start{}; // First address
+		uint16_t end{}; // Address after the last instruction
+		uint16_t count{}; // Instructions in the block, or the instructions to interpret in one batch when there is no fn
+		uint16_t exits[2]{}; // Successor addresses
+		uint32_t links[2]{}; // Offsets of the exit jumps' rel32 in the code buffer
+		uint8_t exitCount{};
+		bool compiled = false;
+	};
+
+	uint32_t Run(CPU& cpu, uint32_t limit);
+	void SyncQuirks(CPU const& cpu);
+	void Compile(CPU& cpu, uint16_t address);
+	void Invalidate(CPU& cpu);
+	void Link();
+	static bool Worthwhile(CPU& cpu, uint16_t address);
+	static bool Translatable(uint8_t op);
+	static bool SameState(CPU const& a, CPU const& b);
+
+	Block blocks[cst::MEMORY_SIZE / 2]{}; // Blocks by (even) start address
+	uint8_t* code{}; // Executable buffer, starts with the exit stub
+	size_t codeSize{};
+	size_t codeUsed{};
+	QuirkSet quirks{}; // Quirks the blocks were translated with
+};
\ No newline at end of file
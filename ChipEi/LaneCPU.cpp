@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include "LaneCPU.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(__AVX2__)
+	// The 8-bit values of LANE_WIDTH lanes in one AVX2 register
+	struct Bytes {
+		__m256i v;
+	};
+
+	inline Bytes Load(uint8_t const* lanes) { return { _mm256_loadu_si256((__m256i const*)lanes) }; }
+	inline void Store(uint8_t* lanes, Bytes a) { _mm256_storeu_si256((__m256i*)lanes, a.v); }
+	inline Bytes Splat(uint8_t value) { return { _mm256_set1_epi8((char)value) }; }
+	inline Bytes operator+(Bytes a, Bytes b) { return { _mm256_add_epi8(a.v, b.v) }; }
+	inline Bytes AddSaturate(Bytes a, Bytes b) { return { _mm256_adds_epu8(a.v, b.v) }; }
+	inline Bytes operator-(Bytes a, Bytes b) { return { _mm256_sub_epi8(a.v, b.v) }; }
+	inline Bytes operator&(Bytes a, Bytes b) { return { _mm256_and_si256(a.v, b.v) }; }
+	inline Bytes operator|(Bytes a, Bytes b) { return { _mm256_or_si256(a.v, b.v) }; }
+	inline Bytes operator^(Bytes a, Bytes b) { return { _mm256_xor_si256(a.v, b.v) }; }
+	inline Bytes Equal(Bytes a, Bytes b) { return { _mm256_cmpeq_epi8(a.v, b.v) }; }
+
+	// Unsigned a > b: flip the sign bits for the signed compare
+	inline Bytes Greater(Bytes a, Bytes b) {
+		__m256i bias = _mm256_set1_epi8((char)0x80);
+		return { _mm256_cmpgt_epi8(_mm256_xor_si256(a.v, bias), _mm256_xor_si256(b.v, bias)) };
+	}
+
+	inline Bytes ShiftRight1(Bytes a) { return { _mm256_and_si256(_mm256_srli_epi16(a.v, 1), _mm256_set1_epi8(0x7F)) }; }
+	inline Bytes DecrementToZero(Bytes a) { return { _mm256_subs_epu8(a.v, _mm256_set1_epi8(1)) }; }
+	inline Bytes Select(Bytes mask, Bytes a, Bytes b) { return { _mm256_blendv_epi8(b.v, a.v, mask.v) }; }
+	inline uint32_t CountLanes(Bytes mask) { return (uint32_t)std::bitset<32>((uint32_t)_mm256_movemask_epi8(mask.v)).count(); }
+
+	// Mask of the 16-bit lanes equal to value: compare two registers of words, then narrow them to
+	// bytes. The pack interleaves the 128-bit halves, the permute puts them back in lane order.
+	inline Bytes EqualWords(uint16_t const* lanes, uint16_t value) {
+		__m256i splat = _mm256_set1_epi16((short)value);
+		__m256i low = _mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i const*)lanes), splat);
+		__m256i high = _mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i const*)(lanes + 16)), splat);
+		return { _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8) };
+	}
+#else
+	// The 8-bit values of LANE_WIDTH lanes, one element each (loops the compiler may vectorize)
+	struct Bytes {
+		uint8_t v[cst::LANE_WIDTH];
+	};
+
+#define LANE_LOOP(expression) \
+	Bytes r; \
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) \
+		r.v[i] = (uint8_t)(expression); \
+	return r;
+
+	inline Bytes Load(uint8_t const* lanes) { Bytes r; std::memcpy(r.v, lanes, sizeof(r.v)); return r; }
+	inline void Store(uint8_t* lanes, Bytes a) { std::memcpy(lanes, a.v, sizeof(a.v)); }
+	inline Bytes Splat(uint8_t value) { LANE_LOOP(value) }
+	inline Bytes operator+(Bytes a, Bytes b) { LANE_LOOP(a.v[i] + b.v[i]) }
+	inline Bytes AddSaturate(Bytes a, Bytes b) { LANE_LOOP(a.v[i] + b.v[i] > 0xFF ? 0xFF : a.v[i] + b.v[i]) }
+	inline Bytes operator-(Bytes a, Bytes b) { LANE_LOOP(a.v[i] - b.v[i]) }
+	inline Bytes operator&(Bytes a, Bytes b) { LANE_LOOP(a.v[i] & b.v[i]) }
+	inline Bytes operator|(Bytes a, Bytes b) { LANE_LOOP(a.v[i] | b.v[i]) }
+	inline Bytes operator^(Bytes a, Bytes b) { LANE_LOOP(a.v[i] ^ b.v[i]) }
+	inline Bytes Equal(Bytes a, Bytes b) { LANE_LOOP(a.v[i] == b.v[i] ? 0xFF : 0) }
+	inline Bytes Greater(Bytes a, Bytes b) { LANE_LOOP(a.v[i] > b.v[i] ? 0xFF : 0) }
+	inline Bytes ShiftRight1(Bytes a) { LANE_LOOP(a.v[i] >> 1) }
+	inline Bytes DecrementToZero(Bytes a) { LANE_LOOP(a.v[i] > 0 ? a.v[i] - 1 : 0) }
+	inline Bytes Select(Bytes mask, Bytes a, Bytes b) { LANE_LOOP(mask.v[i] ? a.v[i] : b.v[i]) }
+	inline Bytes EqualWords(uint16_t const* lanes, uint16_t value) { LANE_LOOP(lanes[i] == value ? 0xFF : 0) }
+
+	inline uint32_t CountLanes(Bytes mask) {
+		uint32_t count = 0;
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i)
+			count += mask.v[i] & 1u;
+		return count;
+	}
+
+#undef LANE_LOOP
+#endif
+
+	// Write value to the lanes in mask
+	inline void Write(uint8_t* lanes, Bytes mask, Bytes value) {
+		Store(lanes, Select(mask, value, Load(lanes)));
+	}
+}
+
+// Create the lanes of a variant by name, nullptr if there is no such variant.
+// Lanes count unknown opcodes without printing them.
+std::unique_ptr<LaneCPU> LaneCPU::Create(std::string const& variant, size_t laneCount) {
+	std::vector<std::unique_ptr<CPU>> lanes;
+	for (size_t lane = 0; lane < laneCount; ++lane) {
+		std::unique_ptr<CPU> cpu = CPU::Create(variant);
+		if (!cpu)
+			return nullptr;
+		cpu->reportUnknownOpcodes = false;
+		lanes.push_back(std::move(cpu));
+	}
+	return std::unique_ptr<LaneCPU>(new LaneCPU(std::move(lanes)));
+}
+
+LaneCPU::LaneCPU(std::vector<std::unique_ptr<CPU>> lanes) : cpus(std::move(lanes)) {
+	groups.resize((cpus.size() + cst::LANE_WIDTH - 1) / cst::LANE_WIDTH);
+	for (Group& group : groups) {
+		group.sharedMemory = true;
+	}
+
+	for (size_t lane = 0; lane < groups.size() * cst::LANE_WIDTH; ++lane) {
+		Group& group = groups[lane / cst::LANE_WIDTH];
+		if (lane < cpus.size()) {
+			group.active[lane % cst::LANE_WIDTH] = 0xFF;
+			++group.activeCount;
+			group.memory[lane % cst::LANE_WIDTH] = cpus[lane]->memory;
+			LoadLane(lane);
+			LoadQuirks(lane);
+		} else {
+			group.memory[lane % cst::LANE_WIDTH] = cpus[0]->memory;
+		}
+	}
+}
+
+void LaneCPU::LoadROM(uint8_t const* data, size_t size) {
+	for (size_t lane = 0; lane < cpus.size(); ++lane) {
+		cpus[lane]->LoadROM(data, size);
+		LoadLane(lane);
+	}
+	for (Group& group : groups) {
+		group.sharedMemory = true;
+		Rejoin(group);
+	}
+}
+
+void LaneCPU::Seed(size_t lane, uint32_t seed) { cpus[lane]->Seed(seed); }
+
+// Cycle: every lane runs one instruction, then the timers of every lane tick
+void LaneCPU::Cycle() {
+	for (size_t i = 0; i < groups.size(); ++i) {
+		Step(groups[i], &cpus[i * cst::LANE_WIDTH]);
+		TickTimers(groups[i]);
+	}
+}
+
+// Run count Cycles. Groups don't interact, so each group runs all of them before the next one and
+// only the CPUs of one group are in the cache at a time. Once every lane of a group has detached,
+// each lane runs the Cycles until the group rejoins in one go, like an independent CPU.
+void LaneCPU::RunCycles(uint32_t count) {
+	for (size_t i = 0; i < groups.size(); ++i) {
+		Group& group = groups[i];
+		std::unique_ptr<CPU> const* lanes = &cpus[i * cst::LANE_WIDTH];
+		uint32_t cycle = 0;
+		while (cycle < count) {
+			if (group.detachedCount == group.activeCount && group.detachedCycles + 1 < cst::LANE_REJOIN_CYCLES) {
+				// Stores can't be compared across lanes that are at different Cycles
+				uint32_t cycles = std::min(count - cycle, cst::LANE_REJOIN_CYCLES - 1 - group.detachedCycles);
+				uint8_t stored[cst::LANE_WIDTH]{};
+				if (RunDetached(group, lanes, cycles, stored))
+					group.sharedMemory = false;
+				group.detachedCycles += cycles;
+				cycle += cycles;
+				continue;
+			}
+			Step(group, lanes);
+			TickTimers(group);
+			++cycle;
+		}
+	}
+}
+
+// Decrement the delay and sound timers of every lane if they've been set
+void LaneCPU::TickTimers(Group& group) {
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; i += sizeof(Bytes)) {
+		Store(group.delayTimer + i, DecrementToZero(Load(group.delayTimer + i)));
+		Store(group.soundTimer + i, DecrementToZero(Load(group.soundTimer + i)));
+	}
+}
+
+// Write the lane-parallel state of a lane back to its CPU (a detached lane's is there already) and return it
+CPU const& LaneCPU::Lane(size_t lane) {
+	if (!groups[lane / cst::LANE_WIDTH].detached[lane % cst::LANE_WIDTH])
+		StoreLane(lane);
+	return *cpus[lane];
+}
+
+uint8_t* LaneCPU::keypad(size_t lane) { return cpus[lane]->keypad; }
+
+size_t LaneCPU::laneCount() const { return cpus.size(); }
+
+uint64_t LaneCPU::vectorInstructions() const { return vectorCount; }
+
+uint64_t LaneCPU::scalarInstructions() const { return scalarCount; }
+
+// Compare the architectural state of a lane with an independent CPU
+bool LaneCPU::SameState(size_t lane, CPU const& cpu) {
+	CPU const& a = Lane(lane);
+	return std::memcmp(a.registers, cpu.registers, sizeof(a.registers)) == 0
+		&& std::memcmp(a.memory, cpu.memory, sizeof(a.memory)) == 0
+		&& std::memcmp(a.stack, cpu.stack, sizeof(a.stack)) == 0
+		&& std::memcmp(a.video, cpu.video, sizeof(a.video)) == 0
+		&& a.index == cpu.index && a.pc == cpu.pc && a.sp == cpu.sp
+		&& a.delayTimer == cpu.delayTimer && a.soundTimer == cpu.soundTimer
+		&& a.extendedMode == cpu.extendedMode;
+}
+
+// Copy the registers and timers of a lane's CPU into the lane-parallel arrays
+void LaneCPU::LoadLane(size_t lane) {
+	Group& group = groups[lane / cst::LANE_WIDTH];
+	unsigned int i = lane % cst::LANE_WIDTH;
+	CPU const& cpu = *cpus[lane];
+
+	for (unsigned int r = 0; r < cst::REGISTER_COUNT; ++r) {
+		group.registers[r][i] = cpu.registers[r];
+	}
+	group.sp[i] = cpu.sp;
+	group.delayTimer[i] = cpu.delayTimer;
+	group.soundTimer[i] = cpu.soundTimer;
+	group.index[i] = cpu.index;
+	group.pc[i] = cpu.pc;
+}
+
+// Copy the quirks of a lane's CPU into the lane masks
+void LaneCPU::LoadQuirks(size_t lane) {
+	Group& group = groups[lane / cst::LANE_WIDTH];
+	unsigned int i = lane % cst::LANE_WIDTH;
+
+	QuirkSet quirks = cpus[lane]->quirks();
+	group.shiftUsesVy[i] = quirks.shiftUsesVy ? 0xFF : 0;
+	group.logicResetsVF[i] = quirks.logicResetsVF ? 0xFF : 0;
+	group.loadIncrementsIndex[i] = quirks.loadIncrementsIndex ? 0xFF : 0;
+}
+
+// Copy the lane-parallel state of a lane into its CPU
+void LaneCPU::StoreLane(size_t lane) {
+	Group const& group = groups[lane / cst::LANE_WIDTH];
+	unsigned int i = lane % cst::LANE_WIDTH;
+	CPU& cpu = *cpus[lane];
+
+	for (unsigned int r = 0; r < cst::REGISTER_COUNT; ++r) {
+		cpu.registers[r] = group.registers[r][i];
+	}
+	cpu.sp = group.sp[i];
+	cpu.delayTimer = group.delayTimer[i];
+	cpu.soundTimer = group.soundTimer[i];
+	cpu.index = group.index[i];
+	cpu.pc = group.pc[i];
+}
+
+// Move the state of a lane to its CPU, which runs it from the next instruction on
+void LaneCPU::Detach(Group& group, size_t lane) {
+	StoreLane(lane);
+	if (!group.detachedCount)
+		group.detachedCycles = 0;
+	group.detached[lane % cst::LANE_WIDTH] = 0xFF;
+	++group.detachedCount;
+}
+
+// Move the detached lanes of a group back into the lane-parallel arrays
+void LaneCPU::Rejoin(Group& group) {
+	size_t first = (&group - groups.data()) * cst::LANE_WIDTH;
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+		if (group.detached[i]) {
+			LoadLane(first + i);
+			LoadQuirks(first + i);
+			group.detached[i] = 0;
+		}
+	}
+	group.detachedCount = 0;
+	group.pcCount = 0;
+	group.sampleCycles = 0;
+	group.vectorLanes = 0;
+	group.scalarLanes = 0;
+}
+
+// Run cycles Cycles on each detached lane of a group, straight on its CPU. Marks the lanes that
+// stored in stored and returns whether any did.
+bool LaneCPU::RunDetached(Group& group, std::unique_ptr<CPU> const* lanes, uint32_t cycles, uint8_t* stored) {
+	bool anyStored = false;
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+		if (!group.detached[i])
+			continue;
+
+		// Like CPU::Cycle, the group's timers only tick for the lanes left in the arrays
+		CPU& cpu = *lanes[i];
+		uint32_t stores = cpu.storeCount;
+		for (uint32_t cycle = 0; cycle < cycles; ++cycle) {
+			cpu.Execute();
+			cpu.TickTimers();
+		}
+		if (cpu.storeCount != stores) {
+			stored[i] = 0xFF;
+			anyStored = true;
+		}
+	}
+	scalarCount += (uint64_t)group.detachedCount * cycles;
+	return anyStored;
+}
+
+// Run one instruction on every lane of a group. Lanes at the same PC with the same opcode run it
+// together under a mask; instructions the vector path doesn't handle run on the lane's CPU.
+// A lane (nearly) alone at its PC would cost a full-width pass for itself on every instruction, so
+// it detaches and runs on its CPU without going through the arrays until the group rejoins it.
+void LaneCPU::Step(Group& group, std::unique_ptr<CPU> const* lanes) {
+	size_t first = (&group - groups.data()) * cst::LANE_WIDTH;
+	uint8_t stored[cst::LANE_WIDTH]{};
+	bool anyStored = false;
+
+	if (group.detachedCount && ++group.detachedCycles >= cst::LANE_REJOIN_CYCLES)
+		Rejoin(group);
+	bool mostlyScalar = false;
+	if (++group.sampleCycles >= cst::LANE_SAMPLE_CYCLES) {
+		mostlyScalar = group.scalarLanes > group.vectorLanes;
+		group.sampleCycles = 0;
+		group.vectorLanes = 0;
+		group.scalarLanes = 0;
+	}
+	if (group.pcCount >= cst::LANE_DIVERGED_PCS || mostlyScalar) {
+		// Too few lanes per PC, or per vectorized instruction, to gain from the vector path
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			if (group.active[i] && !group.detached[i])
+				Detach(group, first + i);
+		}
+	}
+	if (group.detachedCount) {
+		anyStored = RunDetached(group, lanes, 1, stored);
+		if (anyStored && group.sharedMemory)
+			group.sharedMemory = SameStores(group, lanes, stored);
+	}
+
+	uint8_t pending[cst::LANE_WIDTH];
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; i += sizeof(Bytes)) {
+		Store(pending + i, Load(group.active + i) & (Load(group.detached + i) ^ Splat(0xFF)));
+	}
+
+	group.pcCount = 0;
+	for (unsigned int leader = 0; leader < cst::LANE_WIDTH; ++leader) {
+		if (!pending[leader])
+			continue;
+		++group.pcCount;
+
+		// Fetch like CPU::Fetch: XX00 + 00XX, wrapped to memory
+		uint16_t pc = group.pc[leader];
+		uint16_t high = pc & (cst::MEMORY_SIZE - 1);
+		uint16_t low = (pc + 1) & (cst::MEMORY_SIZE - 1);
+		uint8_t const* memory = group.memory[leader];
+		uint16_t opcode = (memory[high] << 8u) | memory[low];
+
+		// Lanes at the same PC with the same opcode. Without shared memory, the opcode bytes of
+		// each lane are compared too, without branches so the loop stays cheap.
+		uint8_t mask[cst::LANE_WIDTH];
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; i += sizeof(Bytes)) {
+			Store(mask + i, Load(pending + i) & EqualWords(group.pc + i, pc));
+		}
+		if (!group.sharedMemory) {
+			for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+				bool same = group.memory[i][high] == memory[high] && group.memory[i][low] == memory[low];
+				mask[i] &= (uint8_t)-(int)same;
+			}
+		}
+		uint32_t count = 0;
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; i += sizeof(Bytes)) {
+			Bytes m = Load(mask + i);
+			Store(pending + i, Load(pending + i) & (m ^ Splat(0xFF)));
+			count += CountLanes(m);
+		}
+
+		if (anyStored) {
+			std::memset(stored, 0, sizeof(stored));
+			anyStored = false;
+		}
+		if (count <= cst::LANE_DETACH_COUNT) {
+			// Detach, this Cycle already runs on the lane's CPU, timers included
+			for (unsigned int i = leader; i < cst::LANE_WIDTH; ++i) {
+				if (mask[i]) {
+					CPU& cpu = *lanes[i];
+					uint32_t stores = cpu.storeCount;
+					Detach(group, first + i);
+					cpu.Execute();
+					cpu.TickTimers();
+					if (cpu.storeCount != stores) {
+						stored[i] = 0xFF;
+						anyStored = true;
+					}
+				}
+			}
+			scalarCount += count;
+			group.scalarLanes += count;
+
+			if (anyStored && group.sharedMemory)
+				group.sharedMemory = SameStores(group, lanes, stored);
+			continue;
+		}
+
+		if (Execute(group, lanes, mask, opcode, lanes[leader]->variant->ops[opcode])) {
+			vectorCount += count;
+			group.vectorLanes += count;
+			continue;
+		}
+
+		// Scalar fallback, the instruction may change anything
+		for (unsigned int i = leader; i < cst::LANE_WIDTH; ++i) {
+			if (mask[i]) {
+				CPU& cpu = *lanes[i];
+				uint32_t stores = cpu.storeCount;
+				StoreLane(first + i);
+				cpu.Execute();
+				LoadLane(first + i);
+				if (cpu.storeCount != stores) {
+					stored[i] = 0xFF;
+					anyStored = true;
+				}
+			}
+		}
+		scalarCount += count;
+		group.scalarLanes += count;
+
+		if (anyStored && group.sharedMemory)
+			group.sharedMemory = SameStores(group, lanes, stored);
+	}
+}
+
+// Check that the last store of the lanes in stored left every lane's memory the same: all lanes hold
+// the same bytes in each range just written
+bool LaneCPU::SameStores(Group const& group, std::unique_ptr<CPU> const* lanes, uint8_t const* stored) const {
+	uint32_t checkedStart = 0;
+	uint32_t checkedEnd = 0;
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+		if (!stored[i])
+			continue;
+
+		// One store per instruction, lanes running the same instruction mostly store the same range
+		uint32_t start = lanes[i]->lastStore;
+		uint32_t end = start + lanes[i]->lastStoreLength;
+		if (start == checkedStart && end == checkedEnd)
+			continue;
+		checkedStart = start;
+		checkedEnd = end;
+
+		uint8_t const* memory = group.memory[i];
+		for (uint32_t address = start; address < end; ++address) {
+			uint16_t wrapped = address & (cst::MEMORY_SIZE - 1);
+			for (unsigned int j = 0; j < cst::LANE_WIDTH; ++j) {
+				if (group.active[j] && group.memory[j][wrapped] != memory[wrapped])
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Run the instruction on the lanes in mask if it only touches lane-parallel state, without ticking
+// the timers. Mirrors the CPU handlers, including the order of the VF writes. Returns false, without
+// changing anything, for the other instructions.
+bool LaneCPU::Execute(Group& group, std::unique_ptr<CPU> const* lanes, uint8_t const* mask, uint16_t opcode, uint8_t op) {
+	uint8_t x = (opcode & 0x0F00u) >> 8u;
+	uint8_t y = (opcode & 0x00F0u) >> 4u;
+	uint8_t kk = opcode & 0x00FFu;
+	uint16_t nnn = opcode & 0x0FFFu;
+
+	switch (op) {
+	case CPU::ID_1nnn: case CPU::ID_3xkk: case CPU::ID_4xkk: case CPU::ID_5xy0: case CPU::ID_6xkk:
+	case CPU::ID_7xkk: case CPU::ID_8xy0: case CPU::ID_8xy1: case CPU::ID_8xy2: case CPU::ID_8xy3:
+	case CPU::ID_8xy4: case CPU::ID_8xy5: case CPU::ID_8xy6: case CPU::ID_8xy7: case CPU::ID_8xyE:
+	case CPU::ID_9xy0: case CPU::ID_Annn: case CPU::ID_Fx07: case CPU::ID_Fx15: case CPU::ID_Fx18:
+	case CPU::ID_Fx1E: case CPU::ID_Fx29: case CPU::ID_Fx30:
+		break;
+	case CPU::ID_Fx33: case CPU::ID_Fx55: case CPU::ID_Fx65: {
+		// Accesses past the end of memory are left to the CPU
+		unsigned int last = op == CPU::ID_Fx33 ? 2 : x;
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			if (mask[i] && group.index[i] + last >= cst::MEMORY_SIZE)
+				return false;
+		}
+		break;
+	}
+	default:
+		return false;
+	}
+
+	// Increment PC
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+		group.pc[i] += mask[i] & 2u;
+	}
+
+	uint8_t* Vx = group.registers[x];
+	uint8_t* Vy = group.registers[y];
+	uint8_t* VF = group.registers[cst::VF];
+	Bytes const one = Splat(1);
+
+	// One switch per instruction, each case loops over the lanes in Bytes-wide blocks with m the mask
+	// of block i
+#define FOR_EACH_BLOCK(...) \
+	for (unsigned int i = 0; i < cst::LANE_WIDTH; i += sizeof(Bytes)) { \
+		Bytes const m = Load(mask + i); \
+		__VA_ARGS__; \
+	}
+
+	switch (op) {
+	case CPU::ID_1nnn:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.pc[i] = mask[i] ? nnn : group.pc[i];
+		}
+		break;
+	case CPU::ID_3xkk: case CPU::ID_4xkk: case CPU::ID_5xy0: case CPU::ID_9xy0: {
+		// Lanes where Vx equals kk (3xkk, 4xkk) or Vy (5xy0, 9xy0), or differs for 4xkk and 9xy0, skip
+		bool immediate = op == CPU::ID_3xkk || op == CPU::ID_4xkk;
+		Bytes const invert = Splat(op == CPU::ID_4xkk || op == CPU::ID_9xy0 ? 0xFF : 0);
+		uint8_t skip[cst::LANE_WIDTH];
+		FOR_EACH_BLOCK(Store(skip + i, m & (Equal(Load(Vx + i), immediate ? Splat(kk) : Load(Vy + i)) ^ invert)))
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.pc[i] += skip[i] & 2u;
+		}
+		break;
+	}
+	case CPU::ID_6xkk:
+		FOR_EACH_BLOCK(Write(Vx + i, m, Splat(kk)))
+		break;
+	case CPU::ID_7xkk:
+		FOR_EACH_BLOCK(Write(Vx + i, m, Load(Vx + i) + Splat(kk)))
+		break;
+	case CPU::ID_8xy0:
+		FOR_EACH_BLOCK(Write(Vx + i, m, Load(Vy + i)))
+		break;
+	case CPU::ID_8xy1:
+		FOR_EACH_BLOCK(
+			Write(Vx + i, m, Load(Vx + i) | Load(Vy + i));
+			Write(VF + i, m & Load(group.logicResetsVF + i), Splat(0)))
+		break;
+	case CPU::ID_8xy2:
+		FOR_EACH_BLOCK(
+			Write(Vx + i, m, Load(Vx + i) & Load(Vy + i));
+			Write(VF + i, m & Load(group.logicResetsVF + i), Splat(0)))
+		break;
+	case CPU::ID_8xy3:
+		FOR_EACH_BLOCK(
+			Write(Vx + i, m, Load(Vx + i) ^ Load(Vy + i));
+			Write(VF + i, m & Load(group.logicResetsVF + i), Splat(0)))
+		break;
+	case CPU::ID_8xy4:
+		// The sum carried where it differs from the saturated sum
+		FOR_EACH_BLOCK(
+			Bytes sum = Load(Vx + i) + Load(Vy + i);
+			Bytes carry = Equal(AddSaturate(Load(Vx + i), Load(Vy + i)), sum) ^ Splat(0xFF);
+			Write(VF + i, m, carry & one);
+			Write(Vx + i, m, sum))
+		break;
+	case CPU::ID_8xy5:
+		FOR_EACH_BLOCK(
+			Write(VF + i, m, Greater(Load(Vx + i), Load(Vy + i)) & one);
+			Write(Vx + i, m, Load(Vx + i) - Load(Vy + i)))
+		break;
+	case CPU::ID_8xy7:
+		FOR_EACH_BLOCK(
+			Write(VF + i, m, Greater(Load(Vy + i), Load(Vx + i)) & one);
+			Write(Vx + i, m, Load(Vy + i) - Load(Vx + i)))
+		break;
+	case CPU::ID_8xy6:
+		FOR_EACH_BLOCK(
+			Bytes shiftUsesVy = Load(group.shiftUsesVy + i);
+			Write(VF + i, m, Select(shiftUsesVy, Load(Vy + i), Load(Vx + i)) & one);
+			Write(Vx + i, m, ShiftRight1(Select(shiftUsesVy, Load(Vy + i), Load(Vx + i)))))
+		break;
+	case CPU::ID_8xyE:
+		FOR_EACH_BLOCK(
+			Bytes shiftUsesVy = Load(group.shiftUsesVy + i);
+			Write(VF + i, m, Greater(Select(shiftUsesVy, Load(Vy + i), Load(Vx + i)), Splat(0x7F)) & one);
+			Bytes source = Select(shiftUsesVy, Load(Vy + i), Load(Vx + i));
+			Write(Vx + i, m, source + source))
+		break;
+	case CPU::ID_Annn:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.index[i] = mask[i] ? nnn : group.index[i];
+		}
+		break;
+	case CPU::ID_Fx07:
+		FOR_EACH_BLOCK(Write(Vx + i, m, Load(group.delayTimer + i)))
+		break;
+	case CPU::ID_Fx15:
+		FOR_EACH_BLOCK(Write(group.delayTimer + i, m, Load(Vx + i)))
+		break;
+	case CPU::ID_Fx18:
+		FOR_EACH_BLOCK(Write(group.soundTimer + i, m, Load(Vx + i)))
+		break;
+	case CPU::ID_Fx1E:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.index[i] += mask[i] & Vx[i];
+		}
+		break;
+	case CPU::ID_Fx29:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.index[i] = mask[i] ? cst::FONTSET_START_ADDRESS + 5 * Vx[i] : group.index[i];
+		}
+		break;
+	case CPU::ID_Fx30:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			group.index[i] = mask[i] ? cst::FONTSET_START_ADDRESS + 10 * Vx[i] : group.index[i];
+		}
+		break;
+	case CPU::ID_Fx33:
+		// Per-lane stores to the lane's memory, through its CPU so that its decodes are invalidated
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			if (!mask[i])
+				continue;
+			CPU& cpu = *lanes[i];
+			uint8_t value = Vx[i];
+			cpu.memory[group.index[i] + 2] = value % 10;
+			value /= 10;
+			cpu.memory[group.index[i] + 1] = value % 10;
+			value /= 10;
+			cpu.memory[group.index[i]] = value % 10;
+			cpu.InvalidateCode(group.index[i], 3);
+		}
+		if (group.sharedMemory)
+			group.sharedMemory = SameStores(group, lanes, mask);
+		break;
+	case CPU::ID_Fx55:
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			if (!mask[i])
+				continue;
+			CPU& cpu = *lanes[i];
+			for (unsigned int r = 0; r <= x; ++r) {
+				cpu.memory[group.index[i] + r] = group.registers[r][i];
+			}
+			cpu.InvalidateCode(group.index[i], x + 1);
+			if (group.loadIncrementsIndex[i])
+				group.index[i] += x + 1;
+		}
+		if (group.sharedMemory)
+			group.sharedMemory = SameStores(group, lanes, mask);
+		break;
+	case CPU::ID_Fx65:
+		// Per-lane reads from the lane's memory
+		for (unsigned int i = 0; i < cst::LANE_WIDTH; ++i) {
+			if (!mask[i])
+				continue;
+			for (unsigned int r = 0; r <= x; ++r) {
+				group.registers[r][i] = group.memory[i][group.index[i] + r];
+			}
+			if (group.loadIncrementsIndex[i])
+				group.index[i] += x + 1;
+		}
+		break;
+	}
+#undef FOR_EACH_BLOCK
+	return true;
+}
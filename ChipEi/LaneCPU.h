@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CPU.h"
+
+namespace cst {
+	const unsigned int LANE_WIDTH = 32; // Lanes per group: one AVX2 vector of 8-bit registers
+	const unsigned int LANE_DETACH_COUNT = 4; // Lanes at a PC up to which they leave the vector path for their own CPU
+	const unsigned int LANE_DIVERGED_PCS = 8; // Distinct PCs in a group's Cycle from which all of its lanes detach
+	const unsigned int LANE_SAMPLE_CYCLES = 64; // Cycles over which a group that runs more lanes on their CPUs than vectorized detaches
+	const unsigned int LANE_REJOIN_CYCLES = 1024; // Cycles after which detached lanes try the vector path again
+};
+
+// Many instances of one variant running the same ROM in lockstep, one SIMD lane each.
+// Registers, I, PC, SP and the timers of every lane live in lane-parallel arrays, groups of
+// LANE_WIDTH lanes run their ALU, skip, jump, timer and register load/store instructions together
+// with a lane mask (AVX2 when built with it, /arch:AVX2 or -mavx2, portable loops otherwise).
+// Lanes that diverge run their own instruction on the scalar CPU of the lane, which also holds
+// memory, stack, display, keys and RNG. A lane left alone at its PC detaches: its state moves to
+// its CPU, which runs it directly until the group tries to rejoin it, and RunCycles runs a group
+// whose lanes have all detached one lane after the other. Each Cycle matches CPU::Cycle on every
+// lane exactly.
+class LaneCPU {
+public:
+	static std::unique_ptr<LaneCPU> Create(std::string const& variant, size_t laneCount);
+	void LoadROM(uint8_t const* data, size_t size); // Same ROM in every lane
+	void Seed(size_t lane, uint32_t seed);
+	void Cycle(); // One CPU::Cycle on every lane
+	void RunCycles(uint32_t count);
+
+	CPU const& Lane(size_t lane); // Scalar state of a lane, valid until the next Cycle
+	uint8_t* keypad(size_t lane);
+	size_t laneCount() const;
+	uint64_t vectorInstructions() const; // Lane instructions run by the vector path
+	uint64_t scalarInstructions() const; // Lane instructions run by the scalar CPU
+	bool SameState(size_t lane, CPU const& cpu); // Compare a lane with an independent CPU
+private:
+	// Lane-parallel state of LANE_WIDTH lanes
+	struct Group {
+		uint8_t registers[cst::REGISTER_COUNT][cst::LANE_WIDTH];
+		uint8_t sp[cst::LANE_WIDTH];
+		uint8_t delayTimer[cst::LANE_WIDTH];
+		uint8_t soundTimer[cst::LANE_WIDTH];
+		uint8_t shiftUsesVy[cst::LANE_WIDTH]; // 0xFF where the lane has the quirk
+		uint8_t logicResetsVF[cst::LANE_WIDTH];
+		uint8_t loadIncrementsIndex[cst::LANE_WIDTH];
+		uint8_t active[cst::LANE_WIDTH]; // 0xFF for lanes in use, the last group may be partial
+		uint8_t detached[cst::LANE_WIDTH]; // 0xFF for lanes running on their CPU, their lane-parallel state is stale
+		uint16_t index[cst::LANE_WIDTH];
+		uint16_t pc[cst::LANE_WIDTH];
+		uint8_t const* memory[cst::LANE_WIDTH]; // Memory of each lane's CPU (of lane 0 for unused lanes)
+		bool sharedMemory; // Every lane's memory is the same, lanes at the same PC run the same opcode
+		uint32_t activeCount;
+		uint32_t detachedCount;
+		uint32_t detachedCycles; // Cycles since the detached lanes last rejoined
+		uint32_t pcCount; // Distinct PCs of the attached lanes in the last Cycle
+		uint32_t sampleCycles; // Cycles counted in vectorLanes and scalarLanes
+		uint32_t vectorLanes; // Instructions of attached lanes the vector path ran
+		uint32_t scalarLanes; // Instructions of attached lanes their CPU ran
+	};
+
+	LaneCPU(std::vector<std::unique_ptr<CPU>> lanes);
+	void LoadLane(size_t lane);
+	void StoreLane(size_t lane);
+	void LoadQuirks(size_t lane);
+	void Detach(Group& group, size_t lane);
+	void Rejoin(Group& group);
+	bool RunDetached(Group& group, std::unique_ptr<CPU> const* lanes, uint32_t cycles, uint8_t* stored);
+	void Step(Group& group, std::unique_ptr<CPU> const* lanes);
+	bool Execute(Group& group, std::unique_ptr<CPU> const* lanes, uint8_t const* mask, uint16_t opcode, uint8_t op);
+	void TickTimers(Group& group);
+	bool SameStores(Group const& group, std::unique_ptr<CPU> const* lanes, uint8_t const* stored) const;
+
+	std::vector<std::unique_ptr<CPU>> cpus;
+	std::vector<Group> groups;
+	uint64_t vectorCount = 0;
+	uint64_t scalarCount = 0;
+};
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "Movie.h"
+
+// 64-bit FNV-1a of a byte range
+static uint64_t Fnv(uint8_t const* bytes, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Begin a recording of a CPU that was just seeded and loaded
+void Movie::Start(CPU const& cpu, uint32_t seed, uint32_t instructionsPerFrame) {
+	std::unique_ptr<CPU::State> state(new CPU::State());
+	cpu.SaveState(*state);
+
+	header = Header{};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.seed = seed;
+	header.instructionsPerFrame = instructionsPerFrame;
+	header.memoryHash = Fnv(state->memory, sizeof(state->memory));
+	std::memcpy(header.variant, state->variant, sizeof(header.variant));
+	header.loadFlag = state->loadFlag;
+	header.shiftFlag = state->shiftFlag;
+	header.dottedRenderingFlag = state->dottedRenderingFlag;
+	inputs.clear();
+	lastKeys = 0;
+	for (unsigned int key = 0; key < cst::KEY_COUNT; ++key)
+		lastKeys |= (cpu.keypad[key] ? 1 : 0) << key;
+	if (lastKeys)
+		inputs.push_back({ 0, 0, lastKeys, 0 });
+}
+
+// Record the keypad as it is from instruction cycle of frame on
+void Movie::Record(uint32_t frame, uint32_t cycle, uint8_t const* keypad) {
+	uint16_t keys = 0;
+	for (unsigned int key = 0; key < cst::KEY_COUNT; ++key)
+		keys |= (keypad[key] ? 1 : 0) << key;
+	if (keys == lastKeys)
+		return;
+	inputs.push_back({ frame, cycle, keys, 0 });
+	lastKeys = keys;
+}
+
+// End the recording after frames frames, remembering the state they ended in
+void Movie::Finish(CPU const& cpu, uint32_t frames) {
+	header.frames = frames;
+	header.hash = Hash(cpu);
+	header.inputCount = (uint32_t)inputs.size();
+}
+
+// Write the header and the inputs
+bool Movie::Write(char const* fileName) const {
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+	file.write((char const*)&header, sizeof(header));
+	file.write((char const*)inputs.data(), inputs.size() * sizeof(Input));
+	return (bool)file;
+}
+
+// Read a movie written by the same format version
+bool Movie::Read(char const* fileName) {
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+	file.read((char*)&header, sizeof(header));
+	if (file.gcount() != sizeof(header) || header.magic != MAGIC || header.version != VERSION) {
+		std::cout << "Invalid movie: " << fileName << std::endl;
+		return false;
+	}
+	inputs.resize(header.inputCount);
+	file.read((char*)inputs.data(), inputs.size() * sizeof(Input));
+	if ((size_t)file.gcount() != inputs.size() * sizeof(Input)) {
+		std::cout << "Invalid movie: " << fileName << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Hash of the whole machine state, equal for equal runs
+uint64_t Movie::Hash(CPU const& cpu) {
+	std::unique_ptr<CPU::State> state(new CPU::State());
+	cpu.SaveState(*state);
+	return Fnv((uint8_t const*)state.get(), sizeof(CPU::State));
+}
+
+// Run a movie as fast as possible with the interpreter, print the hash of the final state and check it
+// against the recorded one
+int Movie::Replay(char const* movieFileName, char const* romFileName) {
+	Movie movie;
+	if (!movie.Read(movieFileName))
+		return EXIT_FAILURE;
+	Header const& header = movie.header;
+
+	std::string variant(header.variant, strnlen(header.variant, sizeof(header.variant)));
+	std::unique_ptr<CPU> cpu = CPU::Create(variant);
+	if (!cpu) {
+		std::cout << "Unknown variant: " << variant << std::endl;
+		return EXIT_FAILURE;
+	}
+	cpu->experimental.load_flag = header.loadFlag;
+	cpu->experimental.shift_flag = header.shiftFlag;
+	cpu->experimental.dotted_rendering_flag = header.dottedRenderingFlag;
+	cpu->tickTimersPerCycle = false;
+	cpu->reportUnknownOpcodes = false;
+	cpu->Seed(header.seed);
+	cpu->LoadROM(romFileName);
+	if (!cpu->isRomLoaded())
+		return EXIT_FAILURE;
+	std::unique_ptr<CPU::State> state(new CPU::State());
+	cpu->SaveState(*state);
+	if (Fnv(state->memory, sizeof(state->memory)) != header.memoryHash) {
+		std::cout << "ROM does not match the movie." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t next = 0;
+	uint32_t frame = 0;
+	for (; frame < header.frames && !cpu->shouldClose(); ++frame) {
+		for (; next < movie.inputs.size() && movie.inputs[next].frame <= frame; ++next) {
+			Input const& input = movie.inputs[next];
+			cpu->RunFrameUntil(header.instructionsPerFrame, input.cycle);
+			for (unsigned int key = 0; key < cst::KEY_COUNT; ++key)
+				cpu->keypad[key] = input.keys >> key & 1;
+		}
+		cpu->RunFrame(header.instructionsPerFrame);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	uint64_t const hash = Hash(*cpu);
+
+	std::cout << std::dec << "frames " << frame << " hash " << std::hex << std::setw(16) << std::setfill('0') << hash
+		<< std::dec << std::setfill(' ') << " in " << seconds << " s (" << (uint64_t)(frame / (seconds > 0 ? seconds : 1)) << " frames/s)" << std::endl;
+	if (frame != header.frames) {
+		std::cout << "Replay ended after " << frame << " of " << header.frames << " frames." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (hash != header.hash) {
+		std::cout << "Replay diverged: the final state hash does not match the recorded " << std::hex << std::setw(16)
+			<< std::setfill('0') << header.hash << std::dec << std::setfill(' ') << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "CPU.h"
+
+// Input recording of a run from power-on, replayed to reproduce it exactly.
+// A file is the Header followed by header.inputCount Inputs, plain data in host byte order. An Input
+// sets the whole keypad at an instruction of a frame; the keypad stays as is until the next one.
+class Movie {
+public:
+	static const uint32_t MAGIC = 0x564D3843; // "C8MV"
+	static const uint16_t VERSION = 2;
+
+	struct Header {
+		uint32_t magic;
+		uint16_t version;
+		uint16_t reserved;
+		uint32_t seed; // CPU::Seed of the run
+		uint32_t instructionsPerFrame;
+		uint32_t frames; // Frames run
+		uint32_t inputCount;
+		uint64_t memoryHash; // FNV-1a of the memory at power-on (font and ROM)
+		uint64_t hash; // Movie::Hash of the state after the last frame, checked by Replay
+		char variant[16];
+		bool loadFlag; // Experimental flags at power-on (default variant)
+		bool shiftFlag;
+		bool dottedRenderingFlag;
+		uint8_t padding[5];
+	};
+
+	// Keypad from instruction cycle of frame on, bit n for key n
+	struct Input {
+		uint32_t frame;
+		uint32_t cycle;
+		uint16_t keys;
+		uint16_t reserved;
+	};
+
+	void Start(CPU const& cpu, uint32_t seed, uint32_t instructionsPerFrame); // Call after seeding and loading the ROM
+	void Record(uint32_t frame, uint32_t cycle, uint8_t const* keypad); // Keypad after a change, ignored if the same
+	void Finish(CPU const& cpu, uint32_t frames); // Call with the CPU after its last frame
+	bool Write(char const* fileName) const;
+	bool Read(char const* fileName);
+
+	static int Replay(char const* movieFileName, char const* romFileName);
+	static uint64_t Hash(CPU const& cpu); // FNV-1a of the CPU::State
+
+	Header header{};
+	std::vector<Input> inputs;
+private:
+	uint16_t lastKeys = 0;
+};
\ No newline at end of file
@@ -1,28 +1,67 @@
 #pragma once
+#include <chrono>
 #include <cstdint>
-#include <iostream>
-#include <math.h>
-#include <SDL.h>
-#include <SDL_audio.h>
-#include "CPU.h"
+#include <cstring>
+#include <vector>
 
-const int AMPLITUDE = 28000;
-const int SAMPLE_RATE = 44100;
+// Key press or release with the host time it happened at
+struct KeyEvent {
+	int64_t time; // std::chrono::steady_clock time in ns
+	uint8_t key;
+	bool pressed;
+};
 
+// Display, input and sound backend of the emulator
 class Platform {
 public:
-	Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
-	~Platform();
-	void Update(void const* buffer, int pitch);
-	bool ProcessInput(uint8_t* keys);
-	void ProcessSound(bool play);
-private:
-	void GetAudioDevice();
+	// Frontend commands requested with hotkeys
+	enum Command : uint8_t {
+		COMMAND_NONE = 0,
+		COMMAND_SAVE_STATE = 1 << 0,
+		COMMAND_LOAD_STATE = 1 << 1,
+		COMMAND_REWIND = 1 << 2 // Set on every poll while the rewind key is held
+	};
 
-	SDL_Window* window{};
-	SDL_Renderer* renderer{};
-	SDL_Texture* texture{};
-	SDL_AudioDeviceID dev{};
-};
+	virtual ~Platform() {}
+	// Present a packed 1bpp frame (rows of whole 64-bit words, top bit leftmost).
+	// dirtyRows has bit n set if row n changed since the last Update.
+	virtual void Update(uint64_t const* frame, uint64_t dirtyRows) = 0;
+	virtual bool isVsynced() const { return false; } // Update waits for the display refresh, which paces the caller
+	virtual bool ProcessInput(uint8_t* keys) = 0; // Update the keypad, returns true to quit
+	virtual void ProcessSound(bool play) = 0; // Buzzer state of the frame just run, once per frame (may come from the emulation thread)
+
+	// Append the key changes since the last poll in order, returns true to quit.
+	// The default diffs the keypad of ProcessInput and stamps the changes with the poll time.
+	virtual bool PollKeys(std::vector<KeyEvent>& events) {
+		uint8_t keys[sizeof(polledKeys)];
+		std::memcpy(keys, polledKeys, sizeof(keys));
+		bool quit = ProcessInput(keys);
+		int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		for (uint8_t key = 0; key < sizeof(keys); ++key) {
+			if (keys[key] != polledKeys[key])
+				events.push_back({ now, key, keys[key] != 0 });
+			polledKeys[key] = keys[key];
+		}
+		return quit;
+	}
+
+	// Commands requested since the last call
+	uint8_t TakeCommands() {
+		uint8_t taken = commands;
+		commands = COMMAND_NONE;
+		return taken;
+	}
+protected:
+	// Convert rows [firstRow, firstRow + rowCount) of a packed 1bpp frame to 32-bit pixels, lit pixels get the value on
+	static void Expand(uint64_t const* frame, uint32_t* pixels, int width, int firstRow, int rowCount, uint32_t on) {
+		int const rowWords = (width + 63) / 64;
+		for (int y = firstRow; y < firstRow + rowCount; ++y) {
+			uint64_t const* row = frame + y * rowWords;
+			for (int x = 0; x < width; ++x)
+				*pixels++ = (row[x / 64] >> (63 - x % 64)) & 1 ? on : 0;
+		}
+	}
 
-void audio_callback(void* user_data, uint8_t* raw_buffer, int bytes);
\ No newline at end of file
+	uint8_t polledKeys[16]{}; // Keypad as of the last PollKeys
+	uint8_t commands = COMMAND_NONE; // Requested since the last TakeCommands
+};
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "Profiler.h"
+
+// handlerNames names the handler ids passed to Begin
+Profiler::Profiler(std::vector<std::string> handlerNames)
+	: names(std::move(handlerNames)), counts(names.size()), ticks(names.size()), samples(names.size()), addresses(0x10000),
+	createdTicks(Timestamp()), createdTime(std::chrono::steady_clock::now()) {
+	overheadTicks = UINT64_MAX;
+	for (int i = 0; i < 1000; ++i) {
+		uint64_t const first = Timestamp();
+		overheadTicks = std::min(overheadTicks, Timestamp() - first);
+	}
+}
+
+// Instructions counted so far
+uint64_t Profiler::instructionCount() const {
+	uint64_t total = 0;
+	for (uint64_t count : counts)
+		total += count;
+	return total;
+}
+
+// Length of a timestamp tick, measured against the steady clock over the profiler's lifetime
+double Profiler::NanosecondsPerTick() const {
+	uint64_t const elapsedTicks = Timestamp() - createdTicks;
+	double const elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - createdTime).count();
+	return elapsedTicks ? elapsed / elapsedTicks : 0;
+}
+
+// Host time of all runs of a handler, extrapolated from its samples
+double Profiler::EstimatedNanoseconds(size_t handler, double nanosecondsPerTick) const {
+	if (!samples[handler])
+		return 0;
+	uint64_t const overhead = overheadTicks * samples[handler];
+	uint64_t const handlerTicks = ticks[handler] > overhead ? ticks[handler] - overhead : 0;
+	return (double)handlerTicks * nanosecondsPerTick * counts[handler] / samples[handler];
+}
+
+// Sorted text report: handlers by estimated time (then count), and the topAddresses most executed addresses
+void Profiler::Report(std::ostream& out, size_t topAddresses) const {
+	double const nanosecondsPerTick = NanosecondsPerTick();
+	uint64_t const total = instructionCount();
+	char line[128];
+	std::snprintf(line, sizeof(line), "profile: %llu instructions, 1 handler run in %u timed\n", (unsigned long long)total, SAMPLE_INTERVAL);
+	out << line;
+	if (!total)
+		return;
+
+	std::vector<size_t> handlers;
+	for (size_t handler = 0; handler < counts.size(); ++handler) {
+		if (counts[handler])
+			handlers.push_back(handler);
+	}
+	std::vector<double> time(counts.size());
+	double totalTime = 0;
+	for (size_t handler : handlers)
+		totalTime += time[handler] = EstimatedNanoseconds(handler, nanosecondsPerTick);
+	std::sort(handlers.begin(), handlers.end(), [&](size_t a, size_t b) {
+		return time[a] != time[b] ? time[a] > time[b] : counts[a] > counts[b];
+	});
+
+	out << "Handler  Count         Share   Time (ms)  Share   ns/run  Samples\n";
+	for (size_t handler : handlers) {
+		std::snprintf(line, sizeof(line), "%-7s  %-12llu  %5.1f%%  %9.3f  %5.1f%%  %6.1f  %llu\n", names[handler].c_str(),
+			(unsigned long long)counts[handler], 100.0 * counts[handler] / total, time[handler] / 1e6,
+			totalTime > 0 ? 100.0 * time[handler] / totalTime : 0.0, time[handler] / counts[handler], (unsigned long long)samples[handler]);
+		out << line;
+	}
+
+	std::vector<uint16_t> hot;
+	for (size_t address = 0; address < addresses.size(); ++address) {
+		if (addresses[address])
+			hot.push_back((uint16_t)address);
+	}
+	size_t const shown = std::min(topAddresses, hot.size());
+	std::partial_sort(hot.begin(), hot.begin() + shown, hot.end(), [&](uint16_t a, uint16_t b) { return addresses[a] > addresses[b]; });
+	std::snprintf(line, sizeof(line), "%zu addresses executed, hottest:\nAddress  Count         Share\n", hot.size());
+	out << line;
+	for (size_t i = 0; i < shown; ++i) {
+		std::snprintf(line, sizeof(line), "%03X      %-12llu  %5.1f%%\n", hot[i], (unsigned long long)addresses[hot[i]], 100.0 * addresses[hot[i]] / total);
+		out << line;
+	}
+}
+
+// Write the counts, samples and estimated times of every handler that ran and the count of every address
+bool Profiler::Write(char const* fileName) const {
+	std::ofstream out(fileName);
+	if (!out.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+	double const nanosecondsPerTick = NanosecondsPerTick();
+	out << "{\n  \"instructions\": " << instructionCount() << ",\n  \"sample_interval\": " << SAMPLE_INTERVAL
+		<< ",\n  \"ns_per_tick\": " << nanosecondsPerTick
+		<< ",\n  \"overhead_ticks\": " << overheadTicks << ",\n  \"handlers\": [";
+	char const* separator = "\n";
+	for (size_t handler = 0; handler < counts.size(); ++handler) {
+		if (!counts[handler])
+			continue;
+		out << separator << "    {\"name\": \"" << names[handler] << "\", \"count\": " << counts[handler] << ", \"samples\": "
+			<< samples[handler] << ", \"ticks\": " << ticks[handler] << ", \"ns\": " << (uint64_t)EstimatedNanoseconds(handler, nanosecondsPerTick) << "}";
+		separator = ",\n";
+	}
+	out << "\n  ],\n  \"addresses\": [";
+	separator = "\n";
+	for (size_t address = 0; address < addresses.size(); ++address) {
+		if (!addresses[address])
+			continue;
+		out << separator << "    {\"address\": " << address << ", \"count\": " << addresses[address] << "}";
+		separator = ",\n";
+	}
+	out << "\n  ]\n}\n";
+	return (bool)out;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Execution profile, compiled in only when CHIPEI_PROFILE is defined: without it CPU has no profile hooks.
+//
+// Counts every interpreted instruction per handler (one per opcode class: 8xy4, Dxyn...) and per address, and
+// times one handler run in SAMPLE_INTERVAL with the timestamp counter. A handler's host time is estimated as its
+// sampled ticks, less the cost of reading the counter, scaled by count / samples. Instructions run by JIT or AOT
+// blocks and the ones fast-forwarded by idle loop detection are not counted.
+class Profiler {
+public:
+	static const uint32_t SAMPLE_INTERVAL = 64; // Instructions per timed handler run
+	static const uint64_t MAX_SAMPLE_TICKS = 1 << 20; // Longer samples were preempted and are dropped
+
+	explicit Profiler(std::vector<std::string> handlerNames);
+
+	// Before a handler: count it and start timing it if its sample is due
+	void Begin(uint16_t address, uint8_t handler) {
+		++counts[handler];
+		++addresses[address];
+		if (--countdown == 0) {
+			sampled = handler;
+			start = Timestamp();
+		}
+	}
+
+	// After the handler: stop timing it
+	void End() {
+		if (countdown == 0) {
+			uint64_t const elapsed = Timestamp() - start;
+			if (elapsed < MAX_SAMPLE_TICKS) {
+				ticks[sampled] += elapsed;
+				++samples[sampled];
+			}
+			countdown = SAMPLE_INTERVAL;
+		}
+	}
+
+	uint64_t instructionCount() const;
+	void Report(std::ostream& out, size_t topAddresses) const; // Handlers by estimated time, hottest addresses
+	bool Write(char const* fileName) const; // The whole profile as JSON
+private:
+	static uint64_t Timestamp() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	double NanosecondsPerTick() const;
+	double EstimatedNanoseconds(size_t handler, double nanosecondsPerTick) const;
+
+	std::vector<std::string> names;
+	std::vector<uint64_t> counts; // Runs of each handler
+	std::vector<uint64_t> ticks; // Timestamp ticks of the sampled runs
+	std::vector<uint64_t> samples; // Sampled runs
+	std::vector<uint64_t> addresses; // Instructions run at each address
+	uint32_t countdown = SAMPLE_INTERVAL;
+	uint8_t sampled = 0;
+	uint64_t start = 0;
+	uint64_t overheadTicks; // Ticks between two back-to-back timestamps, included in every sample
+	uint64_t createdTicks; // Timestamp and clock at creation, to convert ticks to time
+	std::chrono::steady_clock::time_point createdTime;
+};
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+
+// Runtime quirk flags, used by the default variant
+struct Experimental {
+	bool dotted_rendering_flag = false;
+	bool load_flag = false;
+	bool shift_flag = false;
+};
+
+// Opcode set on top of the Chip-8 instructions
+enum class Extension : uint8_t {
+	None,
+	SChip, // Super Chip-8
+	Chip8X,
+	Chip8E,
+	Count
+};
+
+// Behaviour of the instructions that differ between variants
+struct QuirkSet {
+	bool shiftUsesVy; // 8xy6/8xyE shift VY into VX instead of shifting VX
+	bool loadIncrementsIndex; // Fx55/Fx65 leave I past the last register
+	bool logicResetsVF; // 8xy1/8xy2/8xy3 reset VF
+	bool clipSprites; // Sprites are clipped at the screen edges instead of wrapping
+	bool dottedRendering; // Sprites are drawn with 2x2 pixels in high res mode too
+	bool jumpUsesVx; // Bnnn jumps to xnn + VX instead of nnn + V0
+
+	bool operator==(QuirkSet const& other) const {
+		return shiftUsesVy == other.shiftUsesVy && loadIncrementsIndex == other.loadIncrementsIndex
+			&& logicResetsVF == other.logicResetsVF && clipSprites == other.clipSprites
+			&& dottedRendering == other.dottedRendering && jumpUsesVx == other.jumpUsesVx;
+	}
+	bool operator!=(QuirkSet const& other) const { return !(*this == other); }
+};
+
+// Every quirk policy below, in the order CPU::Create looks them up
+#define CPU_QUIRK_POLICIES(X) \
+	X(RuntimeQuirks) X(Chip8Quirks) X(Chip48Quirks) X(SChipQuirks) X(Chip8XQuirks) X(Chip8EQuirks)
+
+// Quirk policies for BasicCPU. Get() is constexpr for the fixed variants, so their handlers are
+// compiled without the branches of the other behaviours.
+
+// Cosmac VIP Chip-8
+struct Chip8Quirks {
+	static constexpr char const* name = "chip8";
+	static constexpr Extension extension = Extension::None;
+	static constexpr QuirkSet Get(Experimental const&) { return { true, true, true, true, false, false }; }
+};
+
+// HP-48 Chip-48
+struct Chip48Quirks {
+	static constexpr char const* name = "chip48";
+	static constexpr Extension extension = Extension::None;
+	static constexpr QuirkSet Get(Experimental const&) { return { false, false, false, true, false, true }; }
+};
+
+// Super Chip-8 1.1
+struct SChipQuirks {
+	static constexpr char const* name = "schip";
+	static constexpr Extension extension = Extension::SChip;
+	static constexpr QuirkSet Get(Experimental const&) { return { false, false, false, true, false, true }; }
+};
+
+// Chip-8X
+struct Chip8XQuirks {
+	static constexpr char const* name = "chip8x";
+	static constexpr Extension extension = Extension::Chip8X;
+	static constexpr QuirkSet Get(Experimental const&) { return { true, true, true, true, false, false }; }
+};
+
+// Chip-8E
+struct Chip8EQuirks {
+	static constexpr char const* name = "chip8e";
+	static constexpr Extension extension = Extension::Chip8E;
+	static constexpr QuirkSet Get(Experimental const&) { return { true, true, true, true, false, false }; }
+};
+
+// Chip-8 with the Super Chip-8 opcodes, quirks taken from the Experimental flags at runtime.
+struct RuntimeQuirks {
+	static constexpr char const* name = "default";
+	static constexpr Extension extension = Extension::SChip;
+	static QuirkSet Get(Experimental const& experimental) {
+		return { experimental.shift_flag, experimental.load_flag, false, false, experimental.dotted_rendering_flag, false };
+	}
+};
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+#include "Rewind.h"
+
+static_assert(sizeof(CPU::State) <= 0xFFFF, "Run lengths of the encoding are 16-bit");
+
+// Longest encoding of a state: one run header more than the state itself
+static size_t const MAX_ENCODED_SIZE = sizeof(CPU::State) + 4;
+
+// Equal bytes that end a literal run, shorter runs of them are cheaper stored as literals
+static size_t const MIN_ZERO_RUN = 4;
+
+static CPU::State const zeroState{};
+
+// maxFrames bounds the frames held, bufferBytes the encoded history (raised to hold a few keyframes).
+// The keyframe interval is capped at half the frames, so dropping a group never empties the history.
+Rewind::Rewind(uint32_t maxFrames, size_t bufferBytes, uint32_t keyframeInterval)
+	: ring(std::max(bufferBytes, 4 * MAX_ENCODED_SIZE)), entries(std::max(maxFrames, 2u)), scratch(MAX_ENCODED_SIZE),
+	maxFrames(std::max(maxFrames, 2u)), keyframeInterval(std::max(std::min(keyframeInterval, maxFrames / 2), 1u)) {}
+
+// Encode state XOR base as records of (uint16 equal bytes, uint16 literal bytes, literal bytes XOR base).
+// Trailing equal bytes need no record. Returns the encoded size.
+size_t Rewind::Encode(uint8_t const* state, uint8_t const* base, uint8_t* out) {
+	size_t const size = sizeof(CPU::State);
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size) {
+		size_t const start = i;
+		while (i + 8 <= size) {
+			uint64_t a, b;
+			std::memcpy(&a, state + i, 8);
+			std::memcpy(&b, base + i, 8);
+			if (a != b)
+				break;
+			i += 8;
+		}
+		while (i < size && state[i] == base[i])
+			++i;
+		if (i == size)
+			break;
+
+		size_t const literal = i;
+		size_t same = 0;
+		while (i < size && same < MIN_ZERO_RUN) {
+			same = state[i] == base[i] ? same + 1 : 0;
+			++i;
+		}
+		i -= same;
+
+		uint16_t const counts[2] = { (uint16_t)(literal - start), (uint16_t)(i - literal) };
+		std::memcpy(out + o, counts, sizeof(counts));
+		o += sizeof(counts);
+		for (size_t k = literal; k < i; ++k)
+			out[o++] = state[k] ^ base[k];
+	}
+	return o;
+}
+
+// XOR an encoding into state, which holds the base it was encoded against
+void Rewind::Decode(uint8_t const* in, size_t size, uint8_t* state) {
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size) {
+		uint16_t counts[2];
+		std::memcpy(counts, in + i, sizeof(counts));
+		i += sizeof(counts);
+		o += counts[0];
+		for (size_t k = 0; k < counts[1]; ++k)
+			state[o + k] ^= in[i + k];
+		i += counts[1];
+		o += counts[1];
+	}
+}
+
+// Record a frame as a delta, or as a keyframe when one is due or the delta would cost as much
+void Rewind::Push(CPU::State const& state) {
+	uint8_t const* bytes = (uint8_t const*)&state;
+	bool isKeyframe = first == end || end - lastKeyframe >= keyframeInterval;
+	size_t size = 0;
+	if (!isKeyframe) {
+		size = Encode(bytes, (uint8_t const*)&keyframe, scratch.data());
+		isKeyframe = size > keyframeSize / 2 || !MakeRoom((uint32_t)size);
+	}
+	if (isKeyframe) {
+		size = Encode(bytes, (uint8_t const*)&zeroState, scratch.data());
+		if (!MakeRoom((uint32_t)size)) {
+			Clear();
+			MakeRoom((uint32_t)size);
+		}
+	}
+
+	Entry& entry = entries[end % maxFrames];
+	entry = { head, (uint32_t)size, isKeyframe };
+	std::memcpy(ring.data() + head, scratch.data(), size);
+	head += (uint32_t)size;
+	if (isKeyframe) {
+		lastKeyframe = end;
+		keyframe = state;
+		keyframeSize = (uint32_t)size;
+	}
+	++end;
+}
+
+// Drop the newest frames (at least the newest one is kept) and decode the one left newest
+bool Rewind::StepBack(uint32_t frames, CPU::State& state) {
+	if (end - first < 2)
+		return false;
+	end -= std::min<uint64_t>(frames, end - first - 1);
+
+	Entry const& newest = entries[(end - 1) % maxFrames];
+	head = newest.offset + newest.size;
+
+	// The keyframe of the newest frame, decoded unless it is still the cached one
+	uint64_t key = end - 1;
+	while (!entries[key % maxFrames].keyframe)
+		--key;
+	if (key != lastKeyframe) {
+		Entry const& entry = entries[key % maxFrames];
+		keyframe = zeroState;
+		Decode(ring.data() + entry.offset, entry.size, (uint8_t*)&keyframe);
+		lastKeyframe = key;
+		keyframeSize = entry.size;
+	}
+
+	state = keyframe;
+	if (key != end - 1)
+		Decode(ring.data() + newest.offset, newest.size, (uint8_t*)&state);
+	return true;
+}
+
+// Forget every frame
+void Rewind::Clear() {
+	first = end;
+	head = 0;
+}
+
+// Frames held
+uint32_t Rewind::frameCount() const {
+	return (uint32_t)(end - first);
+}
+
+// Encoded size of the frames held
+size_t Rewind::storedBytes() const {
+	size_t bytes = 0;
+	for (uint64_t frame = first; frame < end; ++frame)
+		bytes += entries[frame % maxFrames].size;
+	return bytes;
+}
+
+// Drop the oldest frames until size bytes and a frame slot are free at head. Only older keyframe groups are
+// dropped, returns false if the space would need the group of the newest frame.
+bool Rewind::MakeRoom(uint32_t size) {
+	uint32_t offset = 0;
+	while (end - first >= maxFrames || !FindSpace(size, offset)) {
+		if (first == end || first == lastKeyframe)
+			return false;
+		DropOldest();
+	}
+	head = offset;
+	return true;
+}
+
+// Find size free bytes after the newest entry, wrapping to the start of the ring if the end is too short
+bool Rewind::FindSpace(uint32_t size, uint32_t& offset) const {
+	if (first == end) {
+		offset = 0;
+		return size <= ring.size();
+	}
+
+	uint32_t const tail = entries[first % maxFrames].offset;
+	if (head > tail) {
+		// Used [tail, head): free at the end, then before tail
+		if (ring.size() - head >= size) {
+			offset = head;
+			return true;
+		}
+		offset = 0;
+		return tail >= size;
+	}
+	// Wrapped, used [tail, end of ring) and [0, head)
+	offset = head;
+	return tail - head >= size;
+}
+
+// Drop the oldest keyframe and its deltas
+void Rewind::DropOldest() {
+	do {
+		++first;
+	} while (first != end && !entries[first % maxFrames].keyframe);
+	if (first == end)
+		head = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CPU.h"
+
+// History of the last frames for stepping backwards, in a fixed-size byte ring.
+// Every frame is stored as the XOR of its CPU::State against the last keyframe, run-length encoded
+// (mostly zeros). Keyframes are the XOR against an all-zero state, stored every keyframeInterval frames
+// or when a delta grows past half a keyframe. Restoring any frame takes at most two decodes.
+// When the ring or the frame limit is full, the oldest keyframe is dropped with its deltas.
+class Rewind {
+public:
+	Rewind(uint32_t maxFrames, size_t bufferBytes, uint32_t keyframeInterval = 60);
+
+	void Push(CPU::State const& state); // Record the state at the end of a frame
+	bool StepBack(uint32_t frames, CPU::State& state); // Drop the newest frames and return the one now newest, false if none is left
+	void Clear();
+	uint32_t frameCount() const;
+	size_t storedBytes() const; // Encoded bytes of the frames held
+private:
+	// Encoded frame in the ring
+	struct Entry {
+		uint32_t offset;
+		uint32_t size;
+		bool keyframe;
+	};
+
+	static size_t Encode(uint8_t const* state, uint8_t const* base, uint8_t* out);
+	static void Decode(uint8_t const* in, size_t size, uint8_t* state);
+	bool MakeRoom(uint32_t size);
+	bool FindSpace(uint32_t size, uint32_t& offset) const;
+	void DropOldest();
+
+	std::vector<uint8_t> ring; // Encoded frames, oldest at entries[first]
+	std::vector<Entry> entries; // By frame number modulo maxFrames
+	std::vector<uint8_t> scratch; // Encoder output
+	uint32_t maxFrames;
+	uint32_t keyframeInterval;
+	uint64_t first = 0; // Frame number of the oldest entry
+	uint64_t end = 0; // Frame number after the newest entry
+	uint64_t lastKeyframe = 0; // Frame number of the keyframe of the newest entry
+	uint32_t head = 0; // Ring offset after the newest entry
+	uint32_t keyframeSize = 0;
+	CPU::State keyframe{}; // Decoded lastKeyframe
+};
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "SDLPlatform.h"
+
+// steady_clock time in ns
+static int64_t Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SDLPlatform::SDLPlatform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+	: pixels((size_t)textureWidth * textureHeight), textureWidth(textureWidth), textureHeight(textureHeight) {
+	if ( SDL_Init(SDL_INIT_EVERYTHING) != 0 )
+		std::cout << "Error : " << SDL_GetError() << std::endl;
+	ticksOrigin = Now() - (int64_t)SDL_GetTicks() * 1000000;
+
+	std::memset(keymap, -1, sizeof(keymap));
+	for (int8_t key = 0; key < 16; ++key)
+		keymap[SDL_GetScancodeFromName(DEFAULT_KEYMAP[key])] = key;
+
+	window = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (!renderer)
+		renderer = SDL_CreateRenderer(window, -1, 0);
+	SDL_RendererInfo info;
+	vsync = renderer && SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+	GetAudioDevice();
+}
+
+SDLPlatform::~SDLPlatform() {
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	if (dev)
+		SDL_CloseAudioDevice(dev);
+	SDL_Quit();
+}
+
+// Open the audio device and start it, the callback plays silence until the buzzer is on
+void SDLPlatform::GetAudioDevice() {
+	SDL_AudioSpec want, have;
+
+	SDL_memset(&want, 0, sizeof(want));
+	want.freq = SAMPLE_RATE;
+	want.format = AUDIO_F32;
+	want.channels = 1;
+	want.samples = 512;
+	want.callback = AudioCallback;
+	want.userdata = this;
+
+	// No allowed changes: SDL converts to the device format, the callback always writes mono float at SAMPLE_RATE
+	dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+	if (!dev) {
+		std::cout << "Error : " << SDL_GetError() << std::endl;
+		return;
+	}
+	SDL_PauseAudioDevice(dev, 0);
+}
+
+// Update function for SDLPlatform class
+void SDLPlatform::Update(uint64_t const* frame, uint64_t dirtyRows) {
+	// Upload each run of changed rows
+	int row = 0;
+	while (row < textureHeight) {
+		if (!(dirtyRows >> row & 1)) {
+			++row;
+			continue;
+		}
+		int end = row + 1;
+		while (end < textureHeight && (dirtyRows >> end & 1))
+			++end;
+
+		uint32_t* rowPixels = pixels.data() + (size_t)row * textureWidth;
+		Expand(frame, rowPixels, textureWidth, row, end - row, 0xFFFFFFFF);
+		SDL_Rect rect = { 0, row, textureWidth, end - row };
+		SDL_UpdateTexture(texture, &rect, rowPixels, textureWidth * sizeof(uint32_t));
+		row = end;
+	}
+
+	SDL_RenderClear(renderer);
+	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+	SDL_RenderPresent(renderer);
+}
+
+// Check if presenting waits for the display refresh
+bool SDLPlatform::isVsynced() const { return vsync; }
+
+// Check if key has been pressed or released
+bool SDLPlatform::ProcessInput(uint8_t* keys) {
+	std::vector<KeyEvent> events;
+	bool quit = PollKeys(events);
+	for (KeyEvent const& event : events)
+		keys[event.key] = event.pressed;
+	return quit;
+}
+
+// Translate the pending key events through the keymap, stamped with the time SDL received them
+bool SDLPlatform::PollKeys(std::vector<KeyEvent>& events) {
+	bool quit = false;
+	SDL_Event event;
+	int64_t const now = Now();
+
+	while (SDL_PollEvent(&event)) {
+		if (event.type == SDL_QUIT) {
+			quit = true;
+		} else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+			SDL_Scancode scancode = event.key.keysym.scancode;
+			if (scancode == SDL_SCANCODE_ESCAPE)
+				quit = true;
+			if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+				if (scancode == SAVE_STATE_KEY)
+					commands |= COMMAND_SAVE_STATE;
+				else if (scancode == LOAD_STATE_KEY)
+					commands |= COMMAND_LOAD_STATE;
+			}
+			if (scancode == REWIND_KEY)
+				rewindHeld = event.type == SDL_KEYDOWN;
+			int8_t key = keymap[scancode];
+			if (key < 0 || event.key.repeat)
+				continue;
+			// SDL timestamps are whole milliseconds
+			int64_t time = ticksOrigin + (int64_t)event.key.timestamp * 1000000;
+			events.push_back({ time < now ? time : now, (uint8_t)key, event.type == SDL_KEYDOWN });
+		}
+	}
+	if (rewindHeld)
+		commands |= COMMAND_REWIND;
+	return quit;
+}
+
+// Replace the keymap with the bindings of a file, invalid lines are reported and skipped
+bool SDLPlatform::LoadKeymap(char const* fileName) {
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		std::cout << "File failed to open." << std::endl;
+		return false;
+	}
+
+	std::memset(keymap, -1, sizeof(keymap));
+	bool loaded = true;
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line)) {
+		++lineNumber;
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream words(line);
+		unsigned int key = 16;
+		if (!(words >> std::hex >> key))
+			continue;
+		std::string name;
+		std::getline(words >> std::ws, name);
+		name = name.substr(0, name.find_last_not_of(" \t\r") + 1);
+
+		SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+		if (key >= 16 || scancode == SDL_SCANCODE_UNKNOWN) {
+			std::cout << fileName << ":" << lineNumber << ": Invalid binding: " << line << std::endl;
+			loaded = false;
+			continue;
+		}
+		keymap[scancode] = (int8_t)key;
+	}
+	return loaded;
+}
+
+// Queue the buzzer state of the frame just run
+void SDLPlatform::ProcessSound(bool play) {
+	if (dev)
+		buzzer.Push(play);
+}
+
+// Audio callback: a square wave while the buzzer is on. Each queued state lasts one frame of samples and
+// the last one is held when the queue runs dry. The phase runs on through silence, so tones start and
+// stop without jumps. Runs on the audio thread: no locks, allocation or I/O.
+void SDLPlatform::AudioCallback(void* userData, uint8_t* stream, int bytes) {
+	SDLPlatform& platform = *(SDLPlatform*)userData;
+	float* samples = (float*)stream;
+	int const count = bytes / (int)sizeof(float);
+
+	for (int i = 0; i < count; ++i) {
+		if (platform.frameSamples == 0) {
+			// Drop states when the emulation got ahead of the audio clock, to keep the latency bounded
+			uint8_t state;
+			while (platform.buzzer.size() > MAX_QUEUED_FRAMES) {
+				platform.buzzer.Pop(state);
+			}
+			if (platform.buzzer.Pop(state))
+				platform.buzzing = state != 0;
+			platform.frameSamples = SAMPLES_PER_FRAME;
+		}
+		--platform.frameSamples;
+
+		samples[i] = platform.buzzing ? (platform.phase < 0.5f ? AMPLITUDE : -AMPLITUDE) : 0.0f;
+		platform.phase += TONE_FREQUENCY / SAMPLE_RATE;
+		if (platform.phase >= 1.0f)
+			platform.phase -= 1.0f;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <SDL.h>
+#include <SDL_audio.h>
+#include <vector>
+#include "Platform.h"
+#include "SpscQueue.h"
+
+const float AMPLITUDE = 0.25f; // Buzzer output level
+const float TONE_FREQUENCY = 440.0f; // Buzzer pitch in Hz
+const int SAMPLE_RATE = 44100;
+const int SAMPLES_PER_FRAME = SAMPLE_RATE / 60; // Audio length of one emulated frame
+const size_t MAX_QUEUED_FRAMES = 4; // Frames of buzzer states kept before the oldest are dropped
+const SDL_Scancode SAVE_STATE_KEY = SDL_SCANCODE_F5;
+const SDL_Scancode LOAD_STATE_KEY = SDL_SCANCODE_F9;
+const SDL_Scancode REWIND_KEY = SDL_SCANCODE_BACKSPACE;
+
+// Keyboard layout of keys 0-F by default, as SDL scancode names: the left side of a QWERTY keyboard
+//   1 2 3 4      1 2 3 C
+//   Q W E R  ->  4 5 6 D
+//   A S D F      7 8 9 E
+//   Z X C V      A 0 B F
+const char* const DEFAULT_KEYMAP[16] = { "X", "1", "2", "3", "Q", "W", "E", "A", "S", "D", "Z", "C", "4", "R", "F", "V" };
+
+// Window, keyboard and audio through SDL.
+// Keymap files have one "<key> <scancode name>" line per binding, key in hex 0-F and the name as SDL
+// spells it (e.g. "Keypad 7"); '#' starts a comment. A key may have several bindings.
+class SDLPlatform : public Platform {
+public:
+	SDLPlatform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
+	~SDLPlatform();
+	void Update(uint64_t const* frame, uint64_t dirtyRows) override;
+	bool ProcessInput(uint8_t* keys) override;
+	bool PollKeys(std::vector<KeyEvent>& events) override;
+	bool LoadKeymap(char const* fileName); // Returns false if the file is missing or has invalid lines
+	bool isVsynced() const override;
+	void ProcessSound(bool play) override;
+private:
+	void GetAudioDevice();
+	static void AudioCallback(void* userData, uint8_t* stream, int bytes);
+
+	SDL_Window* window{};
+	SDL_Renderer* renderer{};
+	SDL_Texture* texture{};
+	SDL_AudioDeviceID dev{};
+	SpscQueue<uint8_t, 16> buzzer; // Buzzer state of each emulated frame, filled by ProcessSound
+	float phase = 0; // Position in the tone period, 0 to 1 (audio thread only)
+	int frameSamples = 0; // Samples left of the current buzzer state (audio thread only)
+	bool buzzing = false; // Current buzzer state (audio thread only)
+	int8_t keymap[SDL_NUM_SCANCODES]; // Keypad key of each scancode, -1 if unmapped
+	bool rewindHeld = false;
+	bool vsync = false; // The renderer presents on the display refresh
+	int64_t ticksOrigin = 0; // steady_clock time in ns at SDL tick 0, for event timestamps
+	std::vector<uint32_t> pixels; // RGBA8888 texture contents
+	int textureWidth;
+	int textureHeight;
+};
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded FIFO between one producer and one consumer thread
+template <class T, size_t Capacity>
+class SpscQueue {
+	static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+	// Producer: append a value, returns false if the queue is full
+	bool Push(T const& value) {
+		size_t const back = tail.load(std::memory_order_relaxed);
+		if (back - head.load(std::memory_order_acquire) == Capacity)
+			return false;
+		items[back & (Capacity - 1)] = value;
+		tail.store(back + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer: take the oldest value, returns false if the queue is empty
+	bool Pop(T& value) {
+		size_t const front = head.load(std::memory_order_relaxed);
+		if (front == tail.load(std::memory_order_acquire))
+			return false;
+		value = items[front & (Capacity - 1)];
+		head.store(front + 1, std::memory_order_release);
+		return true;
+	}
+	// Values waiting, exact only when called from the consumer or the producer with the other side idle
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+private:
+	T items[Capacity]{};
+	std::atomic<size_t> head{ 0 }; // Next value to pop, written by the consumer
+	char padding[64]{}; // Keep head and tail on separate cache lines
+	std::atomic<size_t> tail{ 0 }; // Next free slot, written by the producer
+};
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <chrono>
+#include "Trace.h"
+
+// Open the file, write the header and start the writer thread
+TraceWriter::TraceWriter(char const* fileName) : records(CAPACITY) {
+	file = std::fopen(fileName, "wb");
+	if (!file)
+		return;
+	TraceHeader header = { TraceHeader::MAGIC, TraceHeader::VERSION, sizeof(TraceRecord) };
+	std::fwrite(&header, sizeof(header), 1, file);
+	writer = std::thread(&TraceWriter::Write, this);
+}
+
+// Publish the last partial batch and let the writer drain the ring
+TraceWriter::~TraceWriter() {
+	tail.store(next, std::memory_order_release);
+	stopping.store(true, std::memory_order_release);
+	if (writer.joinable())
+		writer.join();
+	if (file)
+		std::fclose(file);
+}
+
+// Check that the file opened
+bool TraceWriter::isOpen() const { return file != nullptr; }
+
+// Records appended so far
+uint64_t TraceWriter::recordCount() const { return next; }
+
+// Times the ring was full
+uint64_t TraceWriter::stallCount() const { return stalls; }
+
+// Producer: the ring is full, publish what is there and wait for the writer to free some of it
+void TraceWriter::WaitForSpace() {
+	++stalls;
+	tail.store(next, std::memory_order_release);
+	while ((freeUntil = head.load(std::memory_order_acquire) + CAPACITY) == next)
+		std::this_thread::yield();
+}
+
+// Writer thread: write the published records as they come, until stopped and drained
+void TraceWriter::Write() {
+	for (;;) {
+		bool const stop = stopping.load(std::memory_order_acquire);
+		size_t const end = tail.load(std::memory_order_acquire);
+		size_t const begin = head.load(std::memory_order_relaxed);
+		if (begin == end) {
+			if (stop)
+				return;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		// The published records, in up to two spans of the ring
+		size_t const first = begin & (CAPACITY - 1);
+		size_t const count = end - begin;
+		size_t const span = count < CAPACITY - first ? count : CAPACITY - first;
+		std::fwrite(records.data() + first, sizeof(TraceRecord), span, file);
+		std::fwrite(records.data(), sizeof(TraceRecord), count - span, file);
+		head.store(end, std::memory_order_release);
+	}
+}
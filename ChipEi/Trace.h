@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Instruction tracing, compiled in only when CHIPEI_TRACE is defined: without it CPU has no trace hooks.
+//
+// A trace file is a TraceHeader followed by one TraceRecord per executed instruction, in host byte order.
+// Instructions run by JIT or AOT blocks are not traced, their fallbacks through CPU::Cycle are.
+
+// Start of a trace file
+struct TraceHeader {
+	static const uint32_t MAGIC = 0x52543843; // "C8TR"
+	static const uint16_t VERSION = 1;
+
+	uint32_t magic;
+	uint16_t version;
+	uint16_t recordSize; // sizeof(TraceRecord)
+};
+
+// One executed instruction, with the state after it ran
+struct TraceRecord {
+	uint16_t pc; // Address of the instruction
+	uint16_t opcode;
+	uint16_t index; // I
+	uint8_t x; // Register x of the opcode, the one most instructions change
+	uint8_t vx; // Its value
+};
+
+// Collects records into a lock-free single-producer ring; a background thread writes them to the file.
+// The producer publishes every BATCH records, and waits when the writer falls a whole ring behind.
+class TraceWriter {
+public:
+	static const size_t CAPACITY = 1 << 20; // Records in the ring
+	static const size_t BATCH = 256; // Records per publication
+
+	explicit TraceWriter(char const* fileName);
+	~TraceWriter(); // Writes the remaining records and closes the file
+	TraceWriter(TraceWriter const&) = delete;
+	TraceWriter& operator=(TraceWriter const&) = delete;
+
+	bool isOpen() const;
+	uint64_t recordCount() const; // Records so far (producer only)
+	uint64_t stallCount() const; // Times the producer waited for the writer (producer only)
+
+	// Producer: append a record
+	void Record(uint16_t pc, uint16_t opcode, uint16_t index, uint8_t x, uint8_t vx) {
+		if (next - freeUntil == 0)
+			WaitForSpace();
+		records[next & (CAPACITY - 1)] = { pc, opcode, index, x, vx };
+		if ((++next & (BATCH - 1)) == 0)
+			tail.store(next, std::memory_order_release);
+	}
+private:
+	void WaitForSpace();
+	void Write();
+
+	std::vector<TraceRecord> records;
+	FILE* file{};
+	std::thread writer;
+	std::atomic<bool> stopping{ false };
+	size_t next = 0; // Next record to fill (producer only)
+	size_t freeUntil = CAPACITY; // Records the producer may fill without checking head (producer only)
+	uint64_t stalls = 0;
+	char padding[64]{}; // Keep the producer fields and head on separate cache lines
+	std::atomic<size_t> head{ 0 }; // Next record to write, advanced by the writer
+	std::atomic<size_t> tail{ 0 }; // Records published by the producer
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Trace.h"
+
+// Class name of an opcode: its fixed digits, with nnn, x, y, kk and n for its operands
+static std::string OpcodeClass(uint16_t opcode) {
+	char name[5];
+	switch (opcode >> 12) {
+	case 0x0:
+		if ((opcode & 0xFFF0) == 0x00B0 || (opcode & 0xFFF0) == 0x00C0 || (opcode & 0xFFF0) == 0x00D0)
+			std::snprintf(name, sizeof(name), "00%Xn", opcode >> 4 & 0xF);
+		else if ((opcode & 0xFF00) == 0)
+			std::snprintf(name, sizeof(name), "%04X", opcode);
+		else
+			std::snprintf(name, sizeof(name), "0nnn");
+		break;
+	case 0x1: case 0x2: case 0xA: case 0xB:
+		std::snprintf(name, sizeof(name), "%Xnnn", opcode >> 12);
+		break;
+	case 0x3: case 0x4: case 0x6: case 0x7: case 0xC:
+		std::snprintf(name, sizeof(name), "%Xxkk", opcode >> 12);
+		break;
+	case 0xD:
+		std::snprintf(name, sizeof(name), "Dxyn");
+		break;
+	case 0x5: case 0x8: case 0x9:
+		std::snprintf(name, sizeof(name), "%Xxy%X", opcode >> 12, opcode & 0xF);
+		break;
+	default:
+		std::snprintf(name, sizeof(name), "%Xx%02X", opcode >> 12, opcode & 0xFF);
+		break;
+	}
+	return name;
+}
+
+// Check an opcode against a pattern of 4 characters, hex digits match themselves and anything else any digit (8xy4, Dxyn, F*33)
+static bool MatchOpcode(uint16_t opcode, std::string const& pattern) {
+	for (int digit = 0; digit < 4; ++digit) {
+		char const c = pattern[digit];
+		unsigned int const value = opcode >> (12 - 4 * digit) & 0xF;
+		if (c >= '0' && c <= '9' && value != (unsigned int)(c - '0'))
+			return false;
+		if (c >= 'A' && c <= 'F' && value != (unsigned int)(c - 'A' + 10))
+			return false;
+		if (c >= 'a' && c <= 'f' && value != (unsigned int)(c - 'a' + 10))
+			return false;
+	}
+	return true;
+}
+
+// chipei-trace: print or summarize the instructions of a trace written by chipei --trace
+int main(int argc, char** argv) {
+	char const* traceFileName = nullptr;
+	unsigned long low = 0;
+	unsigned long high = 0xFFFF;
+	std::string pattern;
+	uint64_t limit = UINT64_MAX;
+	bool summary = false;
+	size_t top = 20;
+	bool valid = true;
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string option = argv[arg];
+		try {
+			if (option == "--pc" && arg + 1 < argc) {
+				std::string range = argv[++arg];
+				size_t dash = range.find('-');
+				low = std::stoul(range.substr(0, dash), nullptr, 16);
+				high = dash == std::string::npos ? low : std::stoul(range.substr(dash + 1), nullptr, 16);
+			} else if (option == "--op" && arg + 1 < argc && std::string(argv[arg + 1]).size() == 4) {
+				pattern = argv[++arg];
+			} else if (option == "--limit" && arg + 1 < argc) {
+				limit = std::stoull(argv[++arg]);
+			} else if (option == "--summary") {
+				summary = true;
+			} else if (option == "--top" && arg + 1 < argc) {
+				top = std::stoul(argv[++arg]);
+			} else if (option.rfind("--", 0) != 0 && !traceFileName) {
+				traceFileName = argv[arg];
+			} else {
+				valid = false;
+			}
+		} catch (std::exception const&) {
+			valid = false;
+		}
+		if (!valid)
+			break;
+	}
+
+	if (!valid || !traceFileName) {
+		std::cerr << "Usage: " << argv[0] << " <Trace> [--pc <Low>[-<High>]] [--op <Pattern>] [--limit <N>] [--summary [--top <N>]]\n";
+		std::cerr << "Addresses are hex, patterns are 4 characters where hex digits must match (8xy4, Dxyn, F*33).\n";
+		std::cerr << "Prints the matching instructions, or with --summary their counts per opcode class and the hottest addresses.\n";
+		return EXIT_FAILURE;
+	}
+
+	FILE* file = std::fopen(traceFileName, "rb");
+	if (!file) {
+		std::cerr << "File failed to open: " << traceFileName << "\n";
+		return EXIT_FAILURE;
+	}
+	TraceHeader header{};
+	if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != TraceHeader::MAGIC
+		|| header.version != TraceHeader::VERSION || header.recordSize != sizeof(TraceRecord)) {
+		std::cerr << "Invalid trace: " << traceFileName << "\n";
+		std::fclose(file);
+		return EXIT_FAILURE;
+	}
+
+	// Stream the records, traces of long runs do not fit in memory
+	std::vector<TraceRecord> records(1 << 16);
+	std::unordered_map<std::string, uint64_t> classes;
+	std::vector<uint64_t> addresses(0x10000);
+	uint64_t total = 0;
+	uint64_t matched = 0;
+	size_t count;
+	while (matched < limit && (count = std::fread(records.data(), sizeof(TraceRecord), records.size(), file)) != 0) {
+		for (size_t i = 0; i < count && matched < limit; ++i, ++total) {
+			TraceRecord const& record = records[i];
+			if (record.pc < low || record.pc > high || (!pattern.empty() && !MatchOpcode(record.opcode, pattern)))
+				continue;
+			++matched;
+			if (summary) {
+				++classes[OpcodeClass(record.opcode)];
+				++addresses[record.pc];
+			} else {
+				std::printf("%10llu  %03X  %04X  %-4s  I=%03X  V%X=%02X\n", (unsigned long long)total, record.pc,
+					record.opcode, OpcodeClass(record.opcode).c_str(), record.index, record.x & 0xF, record.vx);
+			}
+		}
+	}
+	std::fclose(file);
+	if (!summary)
+		return EXIT_SUCCESS;
+
+	std::printf("%llu instructions read, %llu matched\n", (unsigned long long)total, (unsigned long long)matched);
+	if (!matched)
+		return EXIT_SUCCESS;
+
+	std::vector<std::pair<std::string, uint64_t>> byClass(classes.begin(), classes.end());
+	std::sort(byClass.begin(), byClass.end(), [](auto const& a, auto const& b) { return a.second > b.second; });
+	std::printf("\nOpcode class  Count        Share\n");
+	for (auto const& entry : byClass)
+		std::printf("%-12s  %-11llu  %5.1f%%\n", entry.first.c_str(), (unsigned long long)entry.second, 100.0 * entry.second / matched);
+
+	std::vector<uint16_t> hot;
+	for (size_t address = 0; address < addresses.size(); ++address) {
+		if (addresses[address])
+			hot.push_back((uint16_t)address);
+	}
+	size_t const shown = std::min(top, hot.size());
+	std::partial_sort(hot.begin(), hot.begin() + shown, hot.end(), [&](uint16_t a, uint16_t b) { return addresses[a] > addresses[b]; });
+	std::printf("\n%zu addresses executed, hottest:\nAddress  Count        Share\n", hot.size());
+	for (size_t i = 0; i < shown; ++i)
+		std::printf("%03X      %-11llu  %5.1f%%\n", hot[i], (unsigned long long)addresses[hot[i]], 100.0 * addresses[hot[i]] / matched);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer between one writer and one reader thread. The writer fills back() and
+// publishes it, the reader takes the most recently published slot; slots published in between are skipped.
+// Neither side ever waits for the other.
+template <class T>
+class TripleBuffer {
+public:
+	// Slot the writer fills next
+	T& back() { return slots[backIndex]; }
+
+	// Writer: make back() the latest value and continue in a free slot
+	void Publish() {
+		backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Reader: the latest published value, nullptr if nothing was published since the last call.
+	// The value stays valid until the next call.
+	T const* Latest() {
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return nullptr;
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+		return &slots[frontIndex];
+	}
+private:
+	static const uint8_t INDEX = 3; // Slot number bits of middle
+	static const uint8_t FRESH = 4; // The middle slot was published and not taken yet
+
+	T slots[3]{};
+	std::atomic<uint8_t> middle{ 1 }; // Slot between the two sides, exchanged by both
+	uint8_t backIndex = 0; // Writer only
+	uint8_t frontIndex = 2; // Reader only
+};
\ No newline at end of file
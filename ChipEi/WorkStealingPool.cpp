@@ -0,0 +1,107 @@
+#include <algorithm>
+#include "WorkStealingPool.h"
+
+// Pool and worker index of the calling thread, if it is a worker
+static thread_local WorkStealingPool const* currentPool = nullptr;
+static thread_local unsigned int currentWorker = 0;
+
+WorkStealingPool::WorkStealingPool(unsigned int threadCount) {
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		workers.emplace_back(new Worker());
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&WorkStealingPool::Work, this, i);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+// Queue a task on the calling worker, or on the next worker round-robin
+void WorkStealingPool::Submit(std::function<void()> task) {
+	unsigned int target = currentPool == this ? currentWorker : nextWorker++ % workers.size();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++pending;
+
+		Worker& worker = *workers[target];
+		std::lock_guard<std::mutex> workerLock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+		++queued;
+	}
+	wake.notify_one();
+}
+
+// Block until every submitted task has finished
+void WorkStealingPool::Wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return pending == 0; });
+}
+
+// Number of worker threads
+unsigned int WorkStealingPool::threadCount() const { return (unsigned int)threads.size(); }
+
+// Tasks taken from another worker's deque
+uint64_t WorkStealingPool::stealCount() const { return steals; }
+
+// Worker loop: run tasks until the pool stops and the deques are empty
+void WorkStealingPool::Work(unsigned int self) {
+	currentPool = this;
+	currentWorker = self;
+
+	std::function<void()> task;
+	for (;;) {
+		if (Take(self, task)) {
+			task();
+			task = nullptr;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pending == 0)
+				done.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping && queued <= 0)
+			return;
+	}
+}
+
+// Take the newest task of the own deque, or steal the oldest task of another worker
+bool WorkStealingPool::Take(unsigned int self, std::function<void()>& task) {
+	{
+		Worker& own = *workers[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--queued;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers.size(); ++i) {
+		Worker& victim = *workers[(self + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--queued;
+			++steals;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A worker runs its newest task first and
+// steals the oldest task of another worker once its own deque is empty, so uneven jobs spread out.
+class WorkStealingPool {
+public:
+	explicit WorkStealingPool(unsigned int threadCount = 0); // 0: one thread per hardware thread
+	~WorkStealingPool();
+
+	void Submit(std::function<void()> task); // Tasks submitted by a worker go to its own deque
+	void Wait(); // Block until every submitted task has finished
+
+	unsigned int threadCount() const;
+	uint64_t stealCount() const;
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void Work(unsigned int self);
+	bool Take(unsigned int self, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::mutex mutex; // Guards pending and stopping
+	std::condition_variable wake; // Tasks were queued or the pool is stopping
+	std::condition_variable done; // pending dropped to 0
+	size_t pending = 0; // Submitted tasks that have not finished
+	std::atomic<int64_t> queued{ 0 }; // Tasks waiting in the deques
+	std::atomic<unsigned int> nextWorker{ 0 }; // Round-robin target for outside submissions
+	std::atomic<uint64_t> steals{ 0 };
+	bool stopping = false;
+};
\ No newline at end of file
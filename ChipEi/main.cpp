@@ -1,25 +1,166 @@
 #include <chrono>
+#include <csignal>
+#include <cstring>
 #include <iostream>
 #include <string>
-#include "Platform.h"
+#include "AOT.h"
+#include "Benchmark.h"
+#include "HeadlessPlatform.h"
+#include "SDLPlatform.h"
 #include "CPU.h"
+#include "EmulationThread.h"
+#include "FrameScheduler.h"
+#include "JIT.h"
+#include "Movie.h"
+#include "Profiler.h"
+#include "Rewind.h"
+#include "Trace.h"
+
+// Set by SIGINT/SIGTERM while profiling, ends the run so the profile is reported
+static volatile std::sig_atomic_t interrupted = 0;
 
 int main(int argc, char** argv) {
-	if (argc != 4) {
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+	if (argc >= 3 && std::string(argv[1]) == "--bench") {
+		uint32_t instructions = argc >= 4 ? std::stoul(argv[3]) : 100000000;
+		return BenchmarkDispatch(argv[2], instructions);
+	}
+
+	if (argc >= 4 && argc <= 6 && std::string(argv[1]) == "--bench-lanes") {
+		uint32_t instructions = argc >= 5 ? std::stoul(argv[4]) : 1000000;
+		return BenchmarkLanes(argv[2], std::stoul(argv[3]), instructions, argc == 6 ? argv[5] : RuntimeQuirks::name);
+	}
+
+	if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "--bench-rewind") {
+		return BenchmarkRewind(argv[2], argc >= 4 ? std::stoul(argv[3]) : 10, argc == 5 ? (size_t)std::stoul(argv[4]) * 1024 : 1024 * 1024);
+	}
+
+	if ((argc == 2 || argc == 3) && std::string(argv[1]) == "--bench-draw") {
+		return BenchmarkDraw(argc == 3 ? std::stoul(argv[2]) : 1000000);
+	}
+
+	if (argc >= 4 && std::string(argv[1]) == "--lockstep") {
+		return JIT::Lockstep(argv + 3, argc - 3, std::stoul(argv[2]), RuntimeQuirks::name);
+	}
+
+	if (argc == 4 && std::string(argv[1]) == "--replay") {
+		return Movie::Replay(argv[2], argv[3]);
+	}
+
+	if ((argc == 4 || argc == 5) && std::string(argv[1]) == "--translate") {
+		return AOT::Translate(argv[2], argv[3], argc == 5 ? argv[4] : RuntimeQuirks::name);
+	}
+
+	// Options
+	bool useJit = false;
+	char const* moduleFileName = nullptr;
+	std::string variant = RuntimeQuirks::name;
+	bool headless = false;
+	char const* keyScriptFileName = nullptr;
+	char const* keymapFileName = nullptr;
+	char const* loadStateFileName = nullptr;
+	char const* saveStateFileName = nullptr;
+	char const* movieFileName = nullptr;
+	char const* traceFileName = nullptr;
+	char const* profileFileName = nullptr;
+	bool seeded = false;
+	uint32_t seed = 0;
+	uint32_t runAhead = 0;
+	uint32_t rewindSeconds = 0;
+	size_t rewindMemory = 1024 * 1024; // Bytes
+	uint32_t frameLimit = 0;
+	uint32_t instructionsPerFrame = cst::INSTRUCTIONS_PER_FRAME;
+	int arg = 1;
+	for (; arg < argc && std::string(argv[arg]).rfind("--", 0) == 0; ++arg) {
+		if (std::string(argv[arg]) == "--jit") {
+			useJit = true;
+		} else if (std::string(argv[arg]) == "--aot" && arg + 1 < argc) {
+			moduleFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--variant" && arg + 1 < argc) {
+			variant = argv[++arg];
+		} else if (std::string(argv[arg]) == "--headless") {
+			headless = true;
+		} else if (std::string(argv[arg]) == "--keys" && arg + 1 < argc) {
+			keyScriptFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--keymap" && arg + 1 < argc) {
+			keymapFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--load-state" && arg + 1 < argc) {
+			loadStateFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--save-state" && arg + 1 < argc) {
+			saveStateFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--record" && arg + 1 < argc) {
+			movieFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--trace" && arg + 1 < argc) {
+			traceFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--profile" && arg + 1 < argc) {
+			profileFileName = argv[++arg];
+		} else if (std::string(argv[arg]) == "--seed" && arg + 1 < argc) {
+			seed = std::stoul(argv[++arg]);
+			seeded = true;
+		} else if (std::string(argv[arg]) == "--run-ahead" && arg + 1 < argc) {
+			runAhead = std::stoul(argv[++arg]);
+		} else if (std::string(argv[arg]) == "--rewind" && arg + 1 < argc) {
+			rewindSeconds = std::stoul(argv[++arg]);
+		} else if (std::string(argv[arg]) == "--rewind-memory" && arg + 1 < argc) {
+			rewindMemory = (size_t)std::stoul(argv[++arg]) * 1024;
+		} else if (std::string(argv[arg]) == "--frames" && arg + 1 < argc) {
+			frameLimit = std::stoul(argv[++arg]);
+		} else if (std::string(argv[arg]) == "--ipf" && arg + 1 < argc) {
+			instructionsPerFrame = std::stoul(argv[++arg]);
+		} else if (std::string(argv[arg]) == "--hz" && arg + 1 < argc) {
+			// Instructions per second, rounded to whole instructions per frame
+			uint32_t hz = std::stoul(argv[++arg]);
+			instructionsPerFrame = (hz + cst::FRAMES_PER_SECOND / 2) / cst::FRAMES_PER_SECOND;
+			if (instructionsPerFrame == 0)
+				instructionsPerFrame = 1;
+		} else {
+			std::cerr << "Unknown option: " << argv[arg] << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	if (argc - arg != 2) {
+		std::cerr << "Usage: " << argv[0] << " [--jit] [--aot <Module>] [--keymap <File>] [--load-state <File>] [--save-state <File>]\n";
+		std::cerr << "       " << std::string(std::strlen(argv[0]), ' ') << " [--rewind <Seconds> [--rewind-memory <KB>]] [--run-ahead <N>] [--seed <N>] [--record <Movie>]\n";
+		std::cerr << "       " << std::string(std::strlen(argv[0]), ' ') << " [--trace <File>] [--profile <File>] [--ipf <N> | --hz <N>] [--variant <Name>] <Scale> <ROM>\n";
+		std::cerr << "       " << argv[0] << " --headless [--jit] [--aot <Module>] [--keys <Script>] [--frames <N>] [--load-state <File>]\n";
+		std::cerr << "       " << std::string(std::strlen(argv[0]), ' ') << "            [--save-state <File>] [--seed <N>] [--record <Movie>] [--trace <File>] [--profile <File>]\n";
+		std::cerr << "       " << std::string(std::strlen(argv[0]), ' ') << "            [--ipf <N> | --hz <N>] [--variant <Name>] <Scale> <ROM>\n";
+		std::cerr << "       " << argv[0] << " --bench <ROM> [Instructions]\n";
+		std::cerr << "       " << argv[0] << " --bench-lanes <ROM> <Lanes> [Instructions] [Variant]\n";
+		std::cerr << "       " << argv[0] << " --bench-draw [Draws]\n";
+		std::cerr << "       " << argv[0] << " --bench-rewind <ROM> [Seconds] [KB]\n";
+		std::cerr << "       " << argv[0] << " --replay <Movie> <ROM>\n";
+		std::cerr << "       " << argv[0] << " --lockstep <Instructions> <ROM>...\n";
+		std::cerr << "       " << argv[0] << " --translate <ROM> <Out.cpp> [Variant]\n";
+		std::cerr << "Variants: default, chip8, chip48, schip, chip8x, chip8e\n";
 		std::exit(EXIT_FAILURE);
 	}
 
-	int videoScale = std::stoi(argv[1]);
-	int cycleDelay = std::stoi(argv[2]);
-	char const* romFileName = argv[3];
+	int videoScale = std::stoi(argv[arg]);
+	char const* romFileName = argv[arg + 1];
 
-	Platform platform("ChipEi", cst::VIDEO_WIDTH * videoScale, cst::VIDEO_HEIGHT * videoScale, cst::VIDEO_WIDTH, cst::VIDEO_HEIGHT);
+	std::unique_ptr<Platform> platform;
+	if (headless) {
+		HeadlessPlatform* script = new HeadlessPlatform(keyScriptFileName, cst::VIDEO_WIDTH, cst::VIDEO_HEIGHT, frameLimit);
+		platform.reset(script);
+		if (!script->isScriptLoaded())
+			std::exit(EXIT_FAILURE);
+	} else {
+		SDLPlatform* sdl = new SDLPlatform("ChipEi", cst::VIDEO_WIDTH * videoScale, cst::VIDEO_HEIGHT * videoScale, cst::VIDEO_WIDTH, cst::VIDEO_HEIGHT);
+		platform.reset(sdl);
+		if (keymapFileName && !sdl->LoadKeymap(keymapFileName))
+			std::exit(EXIT_FAILURE);
+	}
 	
-	CPU chip8;
+	std::unique_ptr<CPU> cpu = CPU::Create(variant);
+	if (!cpu) {
+		std::cerr << "Unknown variant: " << variant << "\n";
+		std::exit(EXIT_FAILURE);
+	}
+	CPU& chip8 = *cpu;
 	chip8.LoadROM(romFileName);
 
-	// Flags for load, shift and dotted_rendering
+	// Flags for load, shift and dotted_rendering (default variant only)
 	chip8.experimental.load_flag = false;
 	chip8.experimental.shift_flag = false;
 	chip8.experimental.dotted_rendering_flag = false;
@@ -28,24 +169,191 @@ int main(int argc, char** argv) {
 		std::exit(EXIT_FAILURE);
 	}
 
-	int videoPitch;
+	// The RNG seed is the only other input of a run: --seed and the movie make it reproducible
+	if (!seeded)
+		seed = (uint32_t)std::chrono::system_clock::now().time_since_epoch().count();
+	chip8.Seed(seed);
 
-	auto lastCycleTime = std::chrono::high_resolution_clock::now();
-	
-	bool quit = false;
-	while (!quit) {
-		quit = platform.ProcessInput(chip8.keypad) | chip8.shouldClose();
-		//platform.ProcessSound(chip8.isSoundPlaying());
+	// Movies record from power-on with the interpreter's instruction counts, so they exclude starting from
+	// or jumping to other states and the JIT/AOT (their blocks overrun the frame ends)
+	Movie movie;
+	if (movieFileName) {
+		if (loadStateFileName || rewindSeconds || useJit || moduleFileName) {
+			std::cerr << "--record cannot be combined with --load-state, --rewind, --jit or --aot\n";
+			std::exit(EXIT_FAILURE);
+		}
+		movie.Start(chip8, seed, instructionsPerFrame);
+	}
 
-		videoPitch = sizeof(chip8.current_video[0]) * cst::VIDEO_WIDTH;
+	// Run-ahead and rewind serve the interactive display and controls
+	if (headless && (runAhead || rewindSeconds)) {
+		std::cerr << "--run-ahead and --rewind cannot be combined with --headless\n";
+		std::exit(EXIT_FAILURE);
+	}
 
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+	JIT jit;
+	AOT aot;
+	if (moduleFileName && !aot.Load(moduleFileName, chip8)) {
+		std::exit(EXIT_FAILURE);
+	}
+
+	// Save states: resume from --load-state, headless runs write --save-state when they end.
+	// Interactive runs save (F5) to and load (F9) from --save-state, or <ROM>.state without it.
+	std::unique_ptr<CPU::State> state(new CPU::State());
+	std::string stateFileName = saveStateFileName ? saveStateFileName : std::string(romFileName) + ".state";
+	if (loadStateFileName) {
+		if (!CPU::ReadState(*state, loadStateFileName) || !chip8.LoadState(*state)) {
+			std::cerr << "Invalid state: " << loadStateFileName << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	// Instruction trace of the run, in builds with CHIPEI_TRACE (run-ahead frames are not traced)
+#if defined(CHIPEI_TRACE)
+	std::unique_ptr<TraceWriter> trace;
+	if (traceFileName) {
+		trace.reset(new TraceWriter(traceFileName));
+		if (!trace->isOpen()) {
+			std::cerr << "File failed to open: " << traceFileName << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		chip8.trace = trace.get();
+	}
+#else
+	if (traceFileName) {
+		std::cerr << "--trace needs a build with CHIPEI_TRACE defined\n";
+		std::exit(EXIT_FAILURE);
+	}
+#endif
+
+	// Execution profile of the run, in builds with CHIPEI_PROFILE: reported as text and written to --profile
+	// when the run ends, also by SIGINT/SIGTERM (run-ahead frames are not profiled)
+#if defined(CHIPEI_PROFILE)
+	std::unique_ptr<Profiler> profile;
+	if (profileFileName) {
+		profile.reset(new Profiler(CPU::HandlerNames()));
+		chip8.profile = profile.get();
+		std::signal(SIGINT, [](int) { interrupted = 1; });
+		std::signal(SIGTERM, [](int) { interrupted = 1; });
+	}
+	auto reportProfile = [&]() {
+		if (!profile)
+			return true;
+		profile->Report(std::cout, 20);
+		return profile->Write(profileFileName);
+	};
+#else
+	if (profileFileName) {
+		std::cerr << "--profile needs a build with CHIPEI_PROFILE defined\n";
+		std::exit(EXIT_FAILURE);
+	}
+#endif
 
-		if (dt > cycleDelay) {
-			lastCycleTime = currentTime;
-			chip8.Cycle();
-			platform.Update(chip8.current_video, videoPitch);
+	// Headless: run frame after frame as fast as possible, through the JIT/AOT blocks when given
+	if (headless) {
+		uint32_t frame = 0;
+		chip8.tickTimersPerCycle = !moduleFileName && !useJit;
+		while (!platform->ProcessInput(chip8.keypad) && !chip8.shouldClose() && !interrupted) {
+			if (movieFileName)
+				movie.Record(frame, 0, chip8.keypad);
+			if (moduleFileName)
+				aot.RunFrame(chip8, instructionsPerFrame);
+			else if (useJit)
+				jit.RunFrame(chip8, instructionsPerFrame);
+			else
+				chip8.RunFrame(instructionsPerFrame);
+			platform->Update(chip8.display(), chip8.TakeDirtyRows());
+			++frame;
 		}
+#if defined(CHIPEI_TRACE)
+		if (trace)
+			std::cout << "trace: " << trace->recordCount() << " instructions, " << trace->stallCount() << " stalls" << std::endl;
+#endif
+#if defined(CHIPEI_PROFILE)
+		if (!reportProfile())
+			return EXIT_FAILURE;
+#endif
+		if (movieFileName) {
+			movie.Finish(chip8, frame);
+			if (!movie.Write(movieFileName))
+				return EXIT_FAILURE;
+		}
+		if (saveStateFileName) {
+			chip8.SaveState(*state);
+			if (!CPU::WriteState(*state, saveStateFileName))
+				return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Backspace steps back through the last rewindSeconds, stored in at most rewindMemory bytes
+	std::unique_ptr<Rewind> rewind;
+	if (rewindSeconds)
+		rewind.reset(new Rewind(rewindSeconds * cst::FRAMES_PER_SECOND, rewindMemory));
+
+	// The CPU runs instructionsPerFrame instructions per 60 Hz frame on its own thread. This thread polls input,
+	// sends the timestamped key events over and presents the latest completed frame, uploading the rows that changed.
+	// It is paced by vsync when the platform has it (presenting every refresh), else by its own 60 Hz scheduler:
+	// never both, as a blocking present makes the scheduler see late frames and resync.
+	bool const vsynced = platform->isVsynced();
+	EmulationThread emulation(chip8, instructionsPerFrame, moduleFileName ? &aot : nullptr, useJit ? &jit : nullptr, platform.get(), rewind.get(), movieFileName ? &movie : nullptr);
+	emulation.SetRunAhead(runAhead);
+	FrameScheduler presentation(cst::FRAMES_PER_SECOND);
+	std::vector<KeyEvent> keyEvents; // Polled but not yet sent
+	uint64_t shown[cst::VIDEO_HEIGHT][cst::VIDEO_ROW_WORDS]{};
+	uint64_t dirtyRows = ~0ull;
+	emulation.Start();
+
+	while (!platform->PollKeys(keyEvents) && !emulation.hasExited() && !interrupted) {
+		size_t sent = 0;
+		while (sent < keyEvents.size() && emulation.PushKey(keyEvents[sent]))
+			++sent;
+		keyEvents.erase(keyEvents.begin(), keyEvents.begin() + sent);
+
+		uint8_t commands = platform->TakeCommands();
+		emulation.SetRewinding((commands & Platform::COMMAND_REWIND) != 0);
+		if (commands & Platform::COMMAND_SAVE_STATE)
+			emulation.RequestSave();
+		if (commands & Platform::COMMAND_LOAD_STATE && movieFileName) {
+			std::cout << "States cannot be loaded while recording" << std::endl;
+		} else if (commands & Platform::COMMAND_LOAD_STATE) {
+			if (CPU::ReadState(*state, stateFileName.c_str()) && chip8.CanLoadState(*state) && emulation.RequestLoad(*state))
+				std::cout << "State loaded from " << stateFileName << std::endl;
+			else
+				std::cout << "Invalid state: " << stateFileName << std::endl;
+		}
+		if (emulation.TakeSavedState(*state) && CPU::WriteState(*state, stateFileName.c_str()))
+			std::cout << "State saved to " << stateFileName << std::endl;
+
+		if (EmulationThread::Frame const* frame = emulation.LatestFrame()) {
+			for (unsigned int row = 0; row < cst::VIDEO_HEIGHT; ++row) {
+				if (std::memcmp(shown[row], frame->video[row], sizeof(shown[row])) != 0)
+					dirtyRows |= 1ull << row;
+			}
+			if (dirtyRows)
+				std::memcpy(shown, frame->video, sizeof(shown));
+		}
+		if (dirtyRows || vsynced) {
+			platform->Update(shown[0], dirtyRows);
+			dirtyRows = 0;
+		}
+
+		if (!vsynced)
+			presentation.Wait();
+	}
+	emulation.Stop();
+	emulation.Report(std::cout);
+#if defined(CHIPEI_TRACE)
+	if (trace)
+		std::cout << "trace: " << trace->recordCount() << " instructions, " << trace->stallCount() << " stalls" << std::endl;
+#endif
+#if defined(CHIPEI_PROFILE)
+	if (!reportProfile())
+		return EXIT_FAILURE;
+#endif
+	if (movieFileName) {
+		movie.Finish(chip8, (uint32_t)emulation.frameNumber());
+		if (!movie.Write(movieFileName))
+			return EXIT_FAILURE;
 	}
 }
\ No newline at end of file